@@ -0,0 +1,95 @@
+// Throughput of LockFreeQueue against LockedQueue (what the engine uses), with any number of producers queueing while a
+//  single consumer drains (the pattern of the command buffer lists and AsyncQueue)
+//  usage: lotus-benchmark-lock-free-queue [items per producer]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+import lotus;
+
+namespace
+{
+struct Result
+{
+    double seconds{0};
+    uint64_t received{0};
+    uint64_t sum{0};
+};
+
+template <typename Queue> void consume(Queue& queue, Result& result)
+{
+    auto items = queue.drain();
+    for (auto item : items)
+        result.sum += item;
+    result.received += items.size();
+}
+
+template <typename Queue> Result run(size_t producers, uint64_t items_per_producer)
+{
+    Queue queue;
+    std::atomic<size_t> ready{0};
+    std::atomic<bool> start{false};
+    std::vector<std::jthread> threads;
+    for (size_t producer = 0; producer < producers; ++producer)
+    {
+        threads.emplace_back(
+            [&, producer]
+            {
+                ready.fetch_add(1);
+                while (!start.load(std::memory_order::acquire))
+                    std::this_thread::yield();
+                for (uint64_t i = 0; i < items_per_producer; ++i)
+                    queue.queue(producer * items_per_producer + i);
+            });
+    }
+    while (ready.load() < producers)
+        std::this_thread::yield();
+
+    const uint64_t total = producers * items_per_producer;
+    Result result;
+    const auto begin = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order::release);
+    while (result.received < total)
+        consume(queue, result);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (result.received != total || result.sum != total * (total - 1) / 2)
+    {
+        std::fprintf(stderr, "lost or duplicated items with %zu producers\n", producers);
+        std::exit(EXIT_FAILURE);
+    }
+    return result;
+}
+
+// best of a few runs, in millions of items per second
+template <typename Queue> double throughput(size_t producers, uint64_t items_per_producer)
+{
+    constexpr int runs = 5;
+    double best = 0;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto result = run<Queue>(producers, items_per_producer);
+        best = std::max(best, static_cast<double>(result.received) / result.seconds / 1e6);
+    }
+    return best;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const uint64_t items_per_producer = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+    std::printf("%u hardware threads, %llu items per producer\n", std::thread::hardware_concurrency(),
+                static_cast<unsigned long long>(items_per_producer));
+    std::printf("%9s %16s %16s\n", "producers", "locked (M/s)", "lock-free (M/s)");
+    for (size_t producers : {1, 2, 4, 8, 16, 32})
+    {
+        std::printf("%9zu %16.2f %16.2f\n", producers, throughput<lotus::LockedQueue<uint64_t>>(producers, items_per_producer),
+                    throughput<lotus::LockFreeQueue<uint64_t>>(producers, items_per_producer));
+    }
+}
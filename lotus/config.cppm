@@ -29,6 +29,36 @@ public:
         bool RendererShadowmappingEnabled();
 
     } renderer{};
+    struct Workers
+    {
+        // number of worker threads (not counting the main thread) - 0 uses one per physical core, minus one for
+        //  the main thread
+        uint32_t thread_count{0};
+        // fill every physical core before putting a second worker on any SMT sibling
+        bool smt_aware{true};
+        // pin each worker to its own logical CPU
+        bool pin_threads{false};
+        // how long an idle worker spins (with backoff) waiting for new tasks before it sleeps
+        uint32_t spin_microseconds{50};
+    } workers{};
+    struct Simulation
+    {
+        // fixed simulation ticks per second - 0 ticks once per rendered frame instead
+        uint32_t tick_rate{60};
+        // most ticks a single frame will run to catch up, so one slow frame can't snowball into slower ones
+        uint32_t max_ticks_per_frame{4};
+    } simulation{};
+    struct Animation
+    {
+        // skeletons closer to the camera than this always animate every tick
+        float full_rate_distance{15.f};
+        // further away, skeletons covering less than this fraction of the screen's height halve their update rate
+        //  each time their size halves, down to one update every max_update_interval ticks
+        float full_rate_screen_size{0.1f};
+        uint32_t max_update_interval{8};
+        // skeletons outside the view keep their last pose until they come back into it
+        bool freeze_offscreen{true};
+    } animation{};
     struct Audio
     {
         float master_volume{0.5f};
@@ -1,9 +1,11 @@
 module;
 
 #include <SDL3/SDL.h>
+#include <algorithm>
 #include <chrono>
 #include <coroutine>
 #include <memory>
+#include <optional>
 
 module lotus;
 
@@ -66,18 +68,55 @@ WorkerTask<> Engine::mainLoop()
     {
         co_await Init();
         co_await game->entry();
+        // the game and scene tick at config->simulation.tick_rate, while the components (which fill in each
+        //  frame's GPU data) update once per rendered frame, interpolating between the last two ticks.
+        // each frame is submitted and presented while the next one is simulated - drawFrame has already copied
+        //  everything it needs out of the simulation by then
+        std::optional<WorkerTask<>> submitting;
+        const duration tick_step = config->simulation.tick_rate > 0 ? duration{std::chrono::seconds{1}} / config->simulation.tick_rate : duration{0};
+        duration accumulator{0};
+        time_point frame_time = sim_clock::now();
         while (!closing)
         {
-            time_point new_sim_time = sim_clock::now();
-            duration sim_delta = new_sim_time - simulation_time;
-            simulation_time = new_sim_time;
+            time_point now = sim_clock::now();
+            duration frame_delta = now - frame_time;
+            frame_time = now;
             worker_pool->processFrameWaits();
             // make sure we're on the main thread for any SDL events
             co_await worker_pool->mainThread();
             input->GetInput();
-            co_await game->tick_all(simulation_time, sim_delta);
-            co_await renderer->drawFrame();
+            time_point render_time = now;
+            if (tick_step == duration{0})
+            {
+                simulation_time = now;
+                ++simulation_tick;
+                co_await game->tick_all(simulation_time, frame_delta);
+            }
+            else
+            {
+                // time beyond max_ticks_per_frame is dropped, and the simulation falls behind the wall clock instead
+                accumulator += std::min(frame_delta, tick_step * config->simulation.max_ticks_per_frame);
+                while (accumulator >= tick_step)
+                {
+                    accumulator -= tick_step;
+                    simulation_time += tick_step;
+                    ++simulation_tick;
+                    co_await game->tick_all(simulation_time, tick_step);
+                }
+                // the frame is drawn between the last two ticks, so it never has to extrapolate past the newest one
+                interpolation = std::chrono::duration<float>(accumulator) / std::chrono::duration<float>(tick_step);
+                render_time = simulation_time - tick_step + accumulator;
+            }
+            co_await game->update_all(render_time, frame_delta);
+            if (submitting)
+                co_await *submitting;
+            if (auto frame = co_await renderer->drawFrame())
+                submitting.emplace(renderer->submitFrame(std::move(*frame)));
+            else
+                submitting.reset();
         }
+        if (submitting)
+            co_await *submitting;
     }
     catch (...)
     {
@@ -61,9 +61,15 @@ public:
 
     void set_camera(Component::CameraComponent* _camera) { camera = _camera; }
     time_point getSimulationTime() { return simulation_time; }
+    // number of simulation ticks started so far
+    uint64_t getSimulationTick() const { return simulation_tick; }
+    // how far the frame being drawn is between the last two simulation ticks (always 1 when ticking once per frame)
+    float getInterpolation() const { return interpolation; }
 
 private:
     time_point simulation_time;
+    uint64_t simulation_tick{0};
+    float interpolation{1.f};
     WorkerTask<> mainLoop();
     bool closing{false};
 };
@@ -1,18 +1,28 @@
 module;
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
 #include <coroutine>
 #include <memory>
 #include <optional>
+#include <span>
+#include <utility>
+#include <vector>
 
 export module lotus:entity.component.animation;
 
 import :core.engine;
+import :entity;
 import :entity.component;
+import :entity.component.camera;
+import :entity.component.render_base;
 import :renderer.animation;
 import :renderer.memory;
 import :renderer.skeleton;
 import :renderer.vulkan.renderer;
+import :renderer.vulkan.upload_ring;
 import :util;
 import glm;
 import vulkan_hpp;
@@ -23,8 +33,16 @@ class AnimationComponent : public Component<AnimationComponent>
 {
 public:
     explicit AnimationComponent(Entity*, Engine* engine, std::unique_ptr<Skeleton>&&);
+    // with the component the skeleton is drawn with, the pose is updated less often the smaller it is on screen, and
+    //  not at all while it's out of view (see Config::Animation)
+    explicit AnimationComponent(Entity*, Engine* engine, const RenderBaseComponent& base_component, std::unique_ptr<Skeleton>&&);
 
-    Task<> tick(time_point time, duration delta);
+    WorkerTask<> init();
+    void initWork(ComponentBatch& batch);
+    // samples the animation once per tick
+    void simulate(time_point time, duration delta);
+    // blends the last two ticks' poses for the frame
+    void update(time_point time, duration delta);
     void playAnimation(std::string name, float speed = 1.f, std::optional<std::string> next_anim = {});
     void playAnimation(std::string name, duration anim_duration, std::optional<std::string> next_anim = {});
     void playAnimationLoop(std::string name, float speed = 1.f, uint8_t repetitions = 0);
@@ -37,121 +55,280 @@ public:
         glm::vec3 trans;
         glm::vec3 scale;
     };
-    std::unique_ptr<Buffer> skeleton_bone_buffer;
+    // this frame's bones, shared by every skeleton - valid for components ordered after AnimationComponent
+    vk::Buffer getBoneBuffer() const { return bone_buffer; }
+    // index of this skeleton's first bone in the bone buffer
+    uint32_t getFirstBone() const { return first_bone; }
+    // changes whenever the pose does, so anything derived from it can tell when it's already up to date
+    uint64_t getPoseVersion() const { return pose_version; }
+    // the skeleton's bones as it was created, for skinning before the component has been updated
+    vk::DescriptorBufferInfo getRestPoseBuffer() const
+    {
+        return {.buffer = rest_pose_buffer->buffer, .offset = 0, .range = sizeof(BufferBone) * skeleton->bones.size()};
+    }
+
+    // Uploads the bones of every skeleton together
+    //  each component gets a slice of one upload ring allocation to write its pose into as it updates, and the
+    //  whole allocation is copied into the frame's bone buffer with a single copy and barrier afterwards.  skeletons
+    //  are packed back to back, so skinning can find any of them by bone index alone
+    class Stage
+    {
+    public:
+        void begin(Engine* engine, std::span<std::unique_ptr<AnimationComponent>> components);
+        void end(Engine* engine, std::span<std::unique_ptr<AnimationComponent>> components);
+
+    private:
+        uint32_t frame{0};
+        UploadRing::Allocation upload;
+        std::array<std::unique_ptr<Buffer>, Renderer::getFrameCount()> bone_buffers;
+    };
 
 protected:
-    WorkerTask<> renderWork();
     void changeAnimation(std::string name, float speed);
+    // ticks between poses for the skeleton's size on screen, or 0 while it's out of view
+    uint64_t lodInterval() const;
     static constexpr duration interpolation_time{100ms};
 
     Animation* current_animation{nullptr};
     time_point animation_start;
     std::optional<std::string> next_anim;
     std::vector<Skeleton::Bone> bones_interpolate;
+    // the newest tick's pose, and the one before it
+    std::vector<Animation::BoneTransform> pose;
+    std::vector<Animation::BoneTransform> prev_pose;
+    uint64_t posed_tick{0};
     float anim_speed{1.f};
     bool loop{true};
     uint8_t repetitions{0};
+
+    const RenderBaseComponent* base_component{nullptr};
+    // roughly how far the skeleton reaches from its origin
+    float bounds_radius{0.f};
+    // lodInterval() as of the last frame - worked out in update(), once the frame's transforms have settled, since
+    //  simulate() runs alongside the ticks that move the entity and the camera
+    uint64_t lod_interval{1};
+    // whether the drawn pose has changed since the last frame
+    bool pose_changed{true};
+    uint64_t pose_version{0};
+
+    std::unique_ptr<Buffer> rest_pose_buffer;
+    vk::Buffer bone_buffer;
+    uint32_t first_bone{0};
+    BufferBone* bone_upload{nullptr};
 };
 
 AnimationComponent::AnimationComponent(Entity* _entity, Engine* _engine, std::unique_ptr<Skeleton>&& _skeleton)
     : Component(_entity, _engine), skeleton(std::move(_skeleton))
 {
-    skeleton_bone_buffer = engine->renderer->gpu->memory_manager->GetBuffer(sizeof(BufferBone) * skeleton->bones.size() * engine->renderer->getFrameCount(),
-                                                                            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
-                                                                            vk::MemoryPropertyFlagBits::eDeviceLocal);
     playAnimationLoop("idl");
 }
 
-Task<> AnimationComponent::tick(time_point time, duration delta)
+AnimationComponent::AnimationComponent(Entity* _entity, Engine* _engine, const RenderBaseComponent& _base_component, std::unique_ptr<Skeleton>&& _skeleton)
+    : AnimationComponent(_entity, _engine, std::move(_skeleton))
+{
+    base_component = &_base_component;
+    for (const auto& bone : skeleton->bones)
+    {
+        bounds_radius = std::max(bounds_radius, glm::length(bone.trans));
+    }
+    // bones are joints, and the mesh extends past the outermost ones
+    bounds_radius *= 1.5f;
+}
+
+WorkerTask<> AnimationComponent::init()
+{
+    ComponentBatch batch{engine};
+    initWork(batch);
+    co_await batch.finish();
+}
+
+void AnimationComponent::initWork(ComponentBatch& batch)
+{
+    rest_pose_buffer = engine->renderer->gpu->memory_manager->GetBuffer(sizeof(BufferBone) * skeleton->bones.size(),
+                                                                        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                                                        vk::MemoryPropertyFlagBits::eDeviceLocal);
+    std::vector<BufferBone> bones;
+    bones.reserve(skeleton->bones.size());
+    for (const auto& bone : skeleton->bones)
+    {
+        bones.push_back({.rot = {bone.rot.x, bone.rot.y, bone.rot.z, bone.rot.w}, .trans = bone.trans, .scale = bone.scale});
+    }
+    // copied ahead of everything recorded into the batch, including the initial skinning of meshes created with it
+    batch.upload(rest_pose_buffer->buffer, 0, std::as_bytes(std::span{bones}));
+}
+
+void AnimationComponent::simulate(time_point time, duration delta)
 {
-    if (current_animation)
+    if (!current_animation || lod_interval == 0)
+        return;
+    // staggered, so that skeletons on the same interval don't all update on the same tick
+    if ((engine->getSimulationTick() + (entity ? entity.index : 0)) % lod_interval != 0)
+        return;
+
+    std::swap(prev_pose, pose);
+    pose.resize(skeleton->bones.size());
+    duration animation_delta = time - animation_start;
+    if (animation_delta < 0ms)
+        animation_delta = 0ms;
+    // all this just to floor the duration's rep and cast it back to a uint64_t
+    auto frame_duration = duration(std::chrono::nanoseconds(static_cast<uint64_t>((current_animation->frame_duration / anim_speed).count())));
+    if (animation_delta < interpolation_time)
     {
-        duration animation_delta = time - animation_start;
-        if (animation_delta < 0ms)
-            animation_delta = 0ms;
-        // all this just to floor the duration's rep and cast it back to a uint64_t
-        auto frame_duration = duration(std::chrono::nanoseconds(static_cast<uint64_t>((current_animation->frame_duration / anim_speed).count())));
-        if (animation_delta < interpolation_time)
+        float frame_f = static_cast<float>(animation_delta.count()) / static_cast<float>(interpolation_time.count());
+        size_t frame = (interpolation_time / frame_duration) % current_animation->frameCount();
+        for (uint32_t i = 0; i < skeleton->bones.size(); ++i)
         {
-            float frame_f = static_cast<float>(animation_delta.count()) / static_cast<float>(interpolation_time.count());
-            size_t frame = (interpolation_time / frame_duration) % current_animation->transforms.size();
-            for (uint32_t i = 0; i < skeleton->bones.size(); ++i)
-            {
-                auto& bone = skeleton->bones[i];
-                bone.rot = glm::slerp(bones_interpolate[i].rot, current_animation->transforms[frame][i].rot, frame_f);
-                bone.trans = glm::mix(bones_interpolate[i].trans, current_animation->transforms[frame][i].trans, frame_f);
-                bone.scale = glm::mix(bones_interpolate[i].scale, current_animation->transforms[frame][i].scale, frame_f);
-            }
+            const auto target = current_animation->keyframe(frame, i);
+            pose[i] = {.rot = glm::slerp(bones_interpolate[i].rot, target.rot, frame_f),
+                       .trans = glm::mix(bones_interpolate[i].trans, target.trans, frame_f),
+                       .scale = glm::mix(bones_interpolate[i].scale, target.scale, frame_f)};
+        }
+    }
+    else
+    {
+        float frame_f = static_cast<float>((animation_delta % frame_duration).count()) / static_cast<float>(frame_duration.count());
+        size_t frame = (animation_delta / frame_duration) % current_animation->frameCount();
+        size_t next_frame = (frame + 1) % current_animation->frameCount();
+        current_animation->sample(frame, next_frame, frame_f, pose);
+    }
+    // a skeleton that skipped ticks (see lodInterval) blends from the last pose it had
+    if (prev_pose.size() != pose.size())
+        prev_pose = pose;
+    for (uint32_t i = 0; i < skeleton->bones.size(); ++i)
+    {
+        auto& bone = skeleton->bones[i];
+        bone.rot = pose[i].rot;
+        bone.trans = pose[i].trans;
+        bone.scale = pose[i].scale;
+    }
+    posed_tick = engine->getSimulationTick();
+    pose_changed = true;
+}
+
+void AnimationComponent::update(time_point time, duration delta)
+{
+    lod_interval = lodInterval();
+
+    // the pose only moves between the last two ticks if it was sampled on the newest one
+    const float alpha = engine->getInterpolation();
+    const bool interpolating = !pose.empty() && posed_tick == engine->getSimulationTick() && alpha < 1.f;
+    if (pose_changed || interpolating)
+        ++pose_version;
+    // one more new pose once the interpolation reaches the newest tick
+    pose_changed = interpolating;
+
+    for (size_t i = 0; i < skeleton->bones.size(); ++i)
+    {
+        const auto& bone = skeleton->bones[i];
+        if (interpolating)
+        {
+            const auto rot = glm::slerp(prev_pose[i].rot, pose[i].rot, alpha);
+            bone_upload[i] = {.rot = {rot.x, rot.y, rot.z, rot.w},
+                              .trans = glm::mix(prev_pose[i].trans, pose[i].trans, alpha),
+                              .scale = glm::mix(prev_pose[i].scale, pose[i].scale, alpha)};
         }
         else
         {
-            float frame_f = static_cast<float>((animation_delta % frame_duration).count()) / static_cast<float>(frame_duration.count());
-            size_t frame = (animation_delta / frame_duration) % current_animation->transforms.size();
-            uint32_t next_frame = (frame + 1) % current_animation->transforms.size();
-            for (uint32_t i = 0; i < skeleton->bones.size(); ++i)
-            {
-                auto& bone = skeleton->bones[i];
-                bone.rot = glm::slerp(current_animation->transforms[frame][i].rot, current_animation->transforms[next_frame][i].rot, frame_f);
-                bone.trans = glm::mix(current_animation->transforms[frame][i].trans, current_animation->transforms[next_frame][i].trans, frame_f);
-                bone.scale = glm::mix(current_animation->transforms[frame][i].scale, current_animation->transforms[next_frame][i].scale, frame_f);
-            }
+            bone_upload[i] = {.rot = {bone.rot.x, bone.rot.y, bone.rot.z, bone.rot.w}, .trans = bone.trans, .scale = bone.scale};
         }
     }
-    co_await renderWork();
 }
 
-WorkerTask<> AnimationComponent::renderWork()
+uint64_t AnimationComponent::lodInterval() const
 {
-    vk::CommandBufferAllocateInfo alloc_info;
-    alloc_info.level = vk::CommandBufferLevel::ePrimary;
-    alloc_info.commandPool = *engine->renderer->graphics_pool;
-    alloc_info.commandBufferCount = 1;
+    auto* camera = engine->camera;
+    if (!base_component || !camera)
+        return 1;
+    const auto& settings = engine->config->animation;
 
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique(alloc_info);
-    vk::CommandBufferBeginInfo begin_info = {};
-    begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-    auto command_buffer = std::move(command_buffers[0]);
+    const auto offset = base_component->getPos() - camera->getPos();
+    const float distance = glm::length(offset);
+    const auto scale = base_component->getScale();
+    const float radius = bounds_radius * std::max({scale.x, scale.y, scale.z});
+    if (distance <= std::max(radius, settings.full_rate_distance))
+        return 1;
 
-    command_buffer->begin(begin_info);
+    const float tan_half_fov = std::tan(camera->getFov() / 2.f);
+    if (settings.freeze_offscreen)
+    {
+        // cone around the view direction reaching the frustum's corners, widened by the angle the bounds cover
+        const float view_angle = std::atan(tan_half_fov * std::sqrt(1.f + camera->getAspectRatio() * camera->getAspectRatio()));
+        const float angle = std::acos(std::clamp(glm::dot(offset / distance, camera->getDir()), -1.f, 1.f));
+        if (angle - std::asin(radius / distance) > view_angle)
+            return 0;
+    }
 
-    auto skeleton = this->skeleton.get();
-    auto staging_buffer =
-        engine->renderer->gpu->memory_manager->GetBuffer(sizeof(AnimationComponent::BufferBone) * skeleton->bones.size(), vk::BufferUsageFlagBits::eTransferSrc,
-                                                         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    AnimationComponent::BufferBone* buffer = static_cast<AnimationComponent::BufferBone*>(staging_buffer->map(0, vk::WholeSize, {}));
-    for (size_t i = 0; i < skeleton->bones.size(); ++i)
+    // fraction of the screen's height the bounds cover
+    float screen_size = radius / (distance * tan_half_fov);
+    uint64_t interval = 1;
+    while (screen_size < settings.full_rate_screen_size && interval < settings.max_update_interval)
     {
-        buffer[i].trans = skeleton->bones[i].trans;
-        buffer[i].scale = skeleton->bones[i].scale;
-        buffer[i].rot.x = skeleton->bones[i].rot.x;
-        buffer[i].rot.y = skeleton->bones[i].rot.y;
-        buffer[i].rot.z = skeleton->bones[i].rot.z;
-        buffer[i].rot.w = skeleton->bones[i].rot.w;
+        interval *= 2;
+        screen_size *= 2.f;
     }
-    staging_buffer->unmap();
+    return interval;
+}
 
-    vk::BufferCopy copy_region;
-    copy_region.srcOffset = 0;
-    copy_region.dstOffset = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size() * engine->renderer->getCurrentFrame();
-    copy_region.size = skeleton->bones.size() * sizeof(AnimationComponent::BufferBone);
-    command_buffer->copyBuffer(staging_buffer->buffer, skeleton_bone_buffer->buffer, copy_region);
+void AnimationComponent::Stage::begin(Engine* engine, std::span<std::unique_ptr<AnimationComponent>> components)
+{
+    frame = engine->renderer->getCurrentFrame();
+    uint32_t bone_count = 0;
+    for (auto& component : components)
+    {
+        if (component->removed())
+            continue;
+        component->first_bone = bone_count;
+        bone_count += static_cast<uint32_t>(component->skeleton->bones.size());
+    }
+    vk::DeviceSize size = sizeof(BufferBone) * bone_count;
+    upload = {};
+    if (size == 0)
+        return;
+
+    auto& bone_buffer = bone_buffers[frame];
+    if (!bone_buffer || bone_buffer->getSize() < size)
+    {
+        // grown ahead of time, so that adding a few more skeletons doesn't reallocate every frame
+        if (bone_buffer)
+            engine->worker_pool->gpuResource(std::move(bone_buffer));
+        bone_buffer = engine->renderer->gpu->memory_manager->GetBuffer(
+            size + size / 2, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    }
+    upload = engine->renderer->upload_ring->allocateStorage(size);
+    for (auto& component : components)
+    {
+        if (component->removed())
+            continue;
+        component->bone_buffer = bone_buffer->buffer;
+        component->bone_upload = upload.as<BufferBone>() + component->first_bone;
+    }
+}
+
+void AnimationComponent::Stage::end(Engine* engine, std::span<std::unique_ptr<AnimationComponent>> components)
+{
+    if (upload.size == 0)
+        return;
+
+    auto command_buffer = engine->renderer->getTransientCommandBuffer();
+    command_buffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    vk::BufferCopy copy_region{.srcOffset = upload.offset, .dstOffset = 0, .size = upload.size};
+    command_buffer.copyBuffer(upload.buffer, bone_buffers[frame]->buffer, copy_region);
 
     vk::BufferMemoryBarrier2 barrier{.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
-                                        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
-                                        .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-                                        .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
-                                        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-                                        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-                                        .buffer = skeleton_bone_buffer->buffer,
-                                        .offset = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size() * engine->renderer->getCurrentFrame(),
-                                        .size = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size()};
-
-    command_buffer->pipelineBarrier2({.bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &barrier});
-    command_buffer->end();
-
-    engine->worker_pool->command_buffers.graphics_primary.queue(*command_buffer);
-    engine->worker_pool->gpuResource(std::move(staging_buffer), std::move(command_buffer));
-    co_return;
+                                     .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                                     .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+                                     .dstAccessMask = vk::AccessFlagBits2::eShaderRead,
+                                     .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+                                     .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+                                     .buffer = bone_buffers[frame]->buffer,
+                                     .offset = 0,
+                                     .size = upload.size};
+
+    command_buffer.pipelineBarrier2({.bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &barrier});
+    command_buffer.end();
+
+    engine->worker_pool->command_buffers.graphics_primary.queue(command_buffer);
 }
 
 void AnimationComponent::playAnimation(std::string name, float speed, std::optional<std::string> _next_anim)
@@ -164,7 +341,7 @@ void AnimationComponent::playAnimation(std::string name, float speed, std::optio
 void AnimationComponent::playAnimation(std::string name, duration anim_duration, std::optional<std::string> _next_anim)
 {
     auto& animation = skeleton->animations[name];
-    auto total_duration = animation->frame_duration * (animation->transforms.size() - 1);
+    auto total_duration = animation->frame_duration * (animation->frameCount() - 1);
     auto speed = (float)total_duration.count() / anim_duration.count();
     playAnimation(name, speed, _next_anim);
 }
@@ -179,7 +356,7 @@ void AnimationComponent::playAnimationLoop(std::string name, float speed, uint8_
 void AnimationComponent::playAnimationLoop(std::string name, duration anim_duration, uint8_t _repetitions)
 {
     auto& animation = skeleton->animations[name];
-    auto total_duration = animation->frame_duration * (animation->transforms.size() - 1);
+    auto total_duration = animation->frame_duration * (animation->frameCount() - 1);
     auto speed = (float)total_duration.count() / anim_duration.count();
     playAnimationLoop(name, speed, _repetitions);
 }
@@ -192,7 +369,7 @@ void AnimationComponent::changeAnimation(std::string name, float speed)
     if (new_anim != current_animation)
     {
         current_animation = new_anim;
-        animation_start = sim_clock::now();
+        animation_start = engine->getSimulationTime();
         // copy current bones so that we can interpolate off them to the new animation
         // bones_interpolate = skeleton->bones;
         bones_interpolate.clear();
@@ -15,14 +15,24 @@ CameraComponent::CameraComponent(Entity* _entity, Engine* _engine) : Component(_
 
 Task<> CameraComponent::init() { co_return; }
 
-Task<> CameraComponent::tick(time_point time, duration delta)
+void CameraComponent::update(time_point time, duration delta)
 {
     updated_tick = false;
-    if (update_view)
+    if (!drawn)
     {
-        view = glm::lookAt(pos, target, glm::vec3(0.f, 1.f, 0.f));
+        prev_pos = pos;
+        prev_target = target;
+        drawn = true;
+    }
+    const float alpha = engine->getInterpolation();
+    const bool interpolating = changed_tick == engine->getSimulationTick() && alpha < 1.f;
+    if (update_view || interpolating)
+    {
+        auto draw_pos = interpolating ? glm::mix(prev_pos, pos, alpha) : pos;
+        auto draw_target = interpolating ? glm::mix(prev_target, target, alpha) : target;
+        view = glm::lookAt(draw_pos, draw_target, glm::vec3(0.f, 1.f, 0.f));
         view_inverse = glm::inverse(view);
-        update_view = false;
+        update_view = interpolating;
         updated_tick = true;
     }
     if (update_projection)
@@ -32,17 +42,27 @@ Task<> CameraComponent::tick(time_point time, duration delta)
         update_projection = false;
         updated_tick = true;
     }
-    co_return;
 }
 
 bool CameraComponent::updated() { return updated_tick; }
 
+void CameraComponent::beginChange()
+{
+    if (auto tick = engine->getSimulationTick(); changed_tick != tick)
+    {
+        prev_pos = pos;
+        prev_target = target;
+        changed_tick = tick;
+    }
+    update_view = true;
+}
+
 void CameraComponent::setPos(glm::vec3 _pos)
 {
     if (pos != _pos)
     {
+        beginChange();
         pos = _pos;
-        update_view = true;
     }
 }
 
@@ -50,8 +70,8 @@ void CameraComponent::setTarget(glm::vec3 _target)
 {
     if (target != _target)
     {
+        beginChange();
         target = _target;
-        update_view = true;
     }
 }
 
@@ -78,6 +98,7 @@ void CameraComponent::writeToBuffer(CameraData& buffer)
     buffer.view = view;
     buffer.proj_inverse = projection_inverse;
     buffer.view_inverse = view_inverse;
-    buffer.eye_pos = glm::vec4(pos, 1.0);
+    // the (possibly interpolated) position the view was built from
+    buffer.eye_pos = view_inverse[3];
 }
 } // namespace lotus::Component
@@ -1,6 +1,7 @@
 module;
 
 #include <chrono>
+#include <cstdint>
 #include <memory>
 
 export module lotus:entity.component.camera;
@@ -17,7 +18,7 @@ class CameraComponent : public Component<CameraComponent>
 public:
     explicit CameraComponent(Entity*, Engine* engine);
 
-    Task<> tick(time_point time, duration delta);
+    void update(time_point time, duration delta);
     Task<> init();
 
     // the camera updated something on this tick (for dependant components)
@@ -29,6 +30,8 @@ public:
     glm::vec3 getDir() { return glm::normalize(target - pos); }
 
     void setPerspective(float fov, float aspect_ratio, float near_clip, float far_clip);
+    float getFov() const { return fov; }
+    float getAspectRatio() const { return aspect_ratio; }
     glm::vec3 getPos() const { return pos; }
     glm::mat4 getViewMatrix();
     glm::mat4 getProjMatrix();
@@ -57,9 +60,16 @@ public:
     void writeToBuffer(CameraData& buffer);
 
 protected:
+    // see RenderBaseComponent::beginChange
+    void beginChange();
+
     bool update_view{true};
     glm::vec3 pos{0.f};
     glm::vec3 target{1.f};
+    glm::vec3 prev_pos{0.f};
+    glm::vec3 prev_target{1.f};
+    uint64_t changed_tick{0};
+    bool drawn{false};
     glm::mat4 view{};
     glm::mat4 view_inverse{};
 
@@ -0,0 +1,95 @@
+module;
+
+#include <coroutine>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+module lotus;
+
+import :entity.component;
+
+import :core.engine;
+import :renderer.memory;
+import :renderer.vulkan.renderer;
+import vulkan_hpp;
+
+namespace lotus::Component
+{
+vk::UniqueCommandBuffer ComponentBatch::beginCommandBuffer()
+{
+    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique({
+        .commandPool = *engine->renderer->compute_pool,
+        .level = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1,
+    });
+    command_buffers[0]->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    return std::move(command_buffers[0]);
+}
+
+vk::CommandBuffer ComponentBatch::commandBuffer()
+{
+    if (!command_buffer)
+        command_buffer = beginCommandBuffer();
+    return *command_buffer;
+}
+
+void ComponentBatch::upload(vk::Buffer dst, vk::DeviceSize offset, std::span<const std::byte> data)
+{
+    uploads.push_back({.dst = dst, .dst_offset = offset, .staging_offset = staging_data.size(), .size = data.size()});
+    staging_data.insert(staging_data.end(), data.begin(), data.end());
+}
+
+vk::UniqueCommandBuffer ComponentBatch::recordUploads()
+{
+    if (uploads.empty())
+        return {};
+
+    staging_buffer = engine->renderer->gpu->memory_manager->GetBuffer(staging_data.size(), vk::BufferUsageFlagBits::eTransferSrc,
+                                                                      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    void* data = staging_buffer->map(0, staging_data.size(), {});
+    memcpy(data, staging_data.data(), staging_data.size());
+    staging_buffer->unmap();
+
+    auto upload_buffer = beginCommandBuffer();
+    for (const auto& upload : uploads)
+    {
+        vk::BufferCopy copy_region{.srcOffset = upload.staging_offset, .dstOffset = upload.dst_offset, .size = upload.size};
+        upload_buffer->copyBuffer(staging_buffer->buffer, upload.dst, copy_region);
+    }
+    // submitted ahead of the batch's command buffer, so anything recorded into that can read the uploaded data
+    vk::MemoryBarrier2 barrier{.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+                               .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+                               .dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+                               .dstAccessMask = vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite};
+    upload_buffer->pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+    upload_buffer->end();
+    uploads.clear();
+    staging_data.clear();
+    return upload_buffer;
+}
+
+Task<> ComponentBatch::finish()
+{
+    while (command_buffer || !uploads.empty() || !waiters.empty())
+    {
+        if (auto upload_buffer = recordUploads())
+            co_await engine->renderer->async_compute->compute(std::move(upload_buffer));
+        if (command_buffer)
+        {
+            command_buffer->end();
+            co_await engine->renderer->async_compute->compute(std::move(command_buffer));
+        }
+        staging_buffer.reset();
+        auto resumed = std::exchange(waiters, {});
+        Scope scope{this};
+        for (auto waiter : resumed)
+        {
+            CancellationScope cancellation{CancellationScope::token()};
+            waiter.resume();
+        }
+    }
+}
+} // namespace lotus::Component
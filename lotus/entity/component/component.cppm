@@ -2,18 +2,30 @@ module;
 
 #include "lotus/renderer/sdl_inc.h"
 #include <algorithm>
+#include <atomic>
 #include <concepts>
 #include <coroutine>
+#include <exception>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 export module lotus:entity.component;
 
 import :core.engine;
+import :entity;
+import :entity.component.pool;
+import :renderer.memory;
 import :util;
+import vulkan_hpp;
 
 namespace lotus
 {
@@ -25,17 +37,40 @@ namespace Component
 {
 class ComponentRunners;
 
+// ordering between component types
+//  the runners build a dependency graph from these (transitively, so an ordering through a component type
+//  with no runner is still respected), and the priority keeps the graph acyclic
 export template <typename... Deps> struct Before
 {
     static consteval int priority() { return std::min({(Deps::priority)...}) - 1; }
+    static void predecessors(std::vector<uint32_t>& ids) {}
+    static void successors(std::vector<uint32_t>& ids) { (addDependency<Deps>(ids), ...); }
+
+private:
+    template <typename Dep> static void addDependency(std::vector<uint32_t>& ids)
+    {
+        ids.push_back(Dep::TypeID());
+        Dep::order::successors(ids);
+    }
 };
 export template <typename... Deps> struct After
 {
     static consteval int priority() { return std::max({(Deps::priority)...}) + 1; }
+    static void predecessors(std::vector<uint32_t>& ids) { (addDependency<Deps>(ids), ...); }
+    static void successors(std::vector<uint32_t>& ids) {}
+
+private:
+    template <typename Dep> static void addDependency(std::vector<uint32_t>& ids)
+    {
+        ids.push_back(Dep::TypeID());
+        Dep::order::predecessors(ids);
+    }
 };
 export struct Zero
 {
     static consteval int priority() { return 0; }
+    static void predecessors(std::vector<uint32_t>& ids) {}
+    static void successors(std::vector<uint32_t>& ids) {}
 };
 
 // technically should be some form of is_base_of but it doesn't work with crtp
@@ -45,9 +80,162 @@ concept ComponentConcept = requires(T t) { T::priority; };
 template <typename T>
 concept ComponentTickConcept = ComponentConcept<T> && requires(T t) { t.tick(time_point{}, duration{}); };
 
+// components that never suspend during their per-frame work can implement update() instead of tick(),
+//  which the runner calls in a plain loop without creating a coroutine per component
+template <typename T>
+concept ComponentUpdateConcept = ComponentConcept<T> && requires(T t) { t.update(time_point{}, duration{}); };
+
+// components whose per-frame work is better done in bulk (streaming over their pooled HotData, say) can implement a
+//  static updateAll() instead, which the runner calls with each chunk of its own components
+template <typename T>
+concept ComponentUpdateAllConcept = ComponentConcept<T> && requires(std::span<std::unique_ptr<T>> range) { T::updateAll(range, time_point{}, duration{}); };
+
+// components with per-tick simulation work implement simulate(), which Scene::tick_all runs at the fixed tick rate.
+//  update() is then left to turn the newest ticks' state into the frame's GPU data, interpolating between them
+template <typename T>
+concept ComponentSimulateConcept = ComponentConcept<T> && requires(T t) { t.simulate(time_point{}, duration{}); };
+
 template <typename T>
 concept ComponentInitConcept = ComponentConcept<T> && requires(T t) { t.init(); };
 
+export class ComponentBatch;
+
+// components whose init only records GPU work can implement initWork, so that components created together
+//  (Scene::AddEntities) share a command buffer instead of each submitting their own
+template <typename T>
+concept ComponentInitWorkConcept = ComponentConcept<T> && requires(T t, ComponentBatch& batch) { t.initWork(batch); };
+
+// Batches the init work and runner registration of components created together
+//  while a batch's Scope is active on a thread, make_component records initWork into the batch's command buffer
+//  and suspends until the batch has been submitted and completed, and addComponent holds the components back
+//  until publish().  finish() submits the recorded work, then resumes the waiting components (still under the
+//  batch, so whatever they make next is recorded together too) until a round records nothing.
+//  Anything that happens after a component suspends elsewhere simply isn't batched.
+export class ComponentBatch
+{
+public:
+    explicit ComponentBatch(Engine* _engine) : engine(_engine) {}
+    ComponentBatch(const ComponentBatch&) = delete;
+    ComponentBatch& operator=(const ComponentBatch&) = delete;
+
+    class Scope
+    {
+    public:
+        explicit Scope(ComponentBatch* batch) : previous(std::exchange(current_batch, batch)) {}
+        ~Scope() { current_batch = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ComponentBatch* previous;
+    };
+
+    static ComponentBatch* current() { return current_batch; }
+
+    // begun on first use, on the calling thread's compute pool
+    vk::CommandBuffer commandBuffer();
+    // copy data into dst through the batch's staging buffer
+    //  the copies are submitted before the batch's command buffer, so work recorded into it can read dst
+    void upload(vk::Buffer dst, vk::DeviceSize offset, std::span<const std::byte> data);
+
+    // resumes once the work recorded so far has completed
+    auto wait() { return WaitAwaiter{this}; }
+    Task<> finish();
+
+    template <typename T> void defer(LockedQueue<std::unique_ptr<T>>& target, std::unique_ptr<T>&& component)
+    {
+        auto& list = deferred[&target];
+        if (!list)
+            list = std::make_unique<DeferredComponents<T>>(target);
+        static_cast<DeferredComponents<T>*>(list.get())->components.queue(std::move(component));
+    }
+    // hand the deferred components to their runners, one queue operation per runner
+    void publish()
+    {
+        for (auto& [target, list] : deferred)
+            list->publish();
+        deferred.clear();
+    }
+
+private:
+    class WaitAwaiter
+    {
+    public:
+        WaitAwaiter(ComponentBatch* _batch) : batch(_batch) {}
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiter) { batch->waiters.push_back(awaiter); }
+        void await_resume() noexcept { cancellation.resume(); }
+
+    private:
+        ComponentBatch* batch;
+        CancellationScope::Suspended cancellation;
+    };
+
+    struct DeferredComponentsBase
+    {
+        virtual ~DeferredComponentsBase() = default;
+        virtual void publish() = 0;
+    };
+
+    template <typename T> struct DeferredComponents : public DeferredComponentsBase
+    {
+        explicit DeferredComponents(LockedQueue<std::unique_ptr<T>>& _target) : target(_target) {}
+        virtual void publish() override { target.queue(components); }
+        LockedQueue<std::unique_ptr<T>>& target;
+        LockedQueue<std::unique_ptr<T>> components;
+    };
+
+    struct Upload
+    {
+        vk::Buffer dst;
+        vk::DeviceSize dst_offset;
+        vk::DeviceSize staging_offset;
+        vk::DeviceSize size;
+    };
+
+    vk::UniqueCommandBuffer beginCommandBuffer();
+    vk::UniqueCommandBuffer recordUploads();
+
+    Engine* engine;
+    vk::UniqueCommandBuffer command_buffer;
+    std::vector<std::byte> staging_data;
+    std::vector<Upload> uploads;
+    std::unique_ptr<Buffer> staging_buffer;
+    std::vector<std::coroutine_handle<>> waiters;
+    std::unordered_map<void*, std::unique_ptr<DeferredComponentsBase>> deferred;
+
+    static inline thread_local ComponentBatch* current_batch{nullptr};
+};
+
+// per-frame work shared by every component of a type (one upload covering all of them, for example) can go in a
+//  nested Stage, which the type's runner owns.  begin() is called before any of the components are ticked, and end()
+//  once all of them have been, with every component in the runner (including any already removed)
+template <typename T>
+concept ComponentStageConcept = ComponentConcept<T> && requires(typename T::Stage stage, Engine* engine, std::span<std::unique_ptr<T>> components) {
+    stage.begin(engine, components);
+    stage.end(engine, components);
+};
+
+struct NoStage
+{
+};
+template <typename T> struct StageOf
+{
+    using type = NoStage;
+};
+template <ComponentStageConcept T> struct StageOf<T>
+{
+    using type = typename T::Stage;
+};
+
+// number of components ticked by each worker job - specialize to tune for a component type
+//  the default aims for a chunk of components to fit in L1
+export template <typename T> struct TickChunkSize
+{
+    static constexpr size_t value = std::max<size_t>(8, (32 * 1024) / sizeof(T));
+};
+
 template <typename T>
 concept ComponentInputConcept = ComponentConcept<T> && requires(T t, Input* i, const SDL_Event& e) {
     { t.handleInput(i, e) } -> std::convertible_to<bool>;
@@ -60,14 +248,32 @@ public:
     Component(Component&&) = default;
     Component& operator=(const Component&) = delete;
     Component& operator=(Component&&) = default;
+    using order = Order;
     static constexpr int priority = Order::priority();
     static uint32_t TypeID() { return IDGenerator<ComponentRunners, uint32_t>::template GetNewID<T>(); }
     bool removed() { return _remove; }
     void remove() { _remove = true; }
-    Entity* getEntity() { return entity; }
+    // nullptr once the entity has been destroyed
+    Entity* getEntity() const { return Entity::get(entity); }
+    EntityHandle getEntityHandle() const { return entity; }
+    ComponentHandle<T> getHandle() const { return ComponentPool<T>::handle(static_cast<const T*>(this)); }
+
+    // components are allocated from their type's pool, including through make_unique
+    static void* operator new(std::size_t size) { return ComponentPool<T>::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) { ComponentPool<T>::deallocate(ptr, size); }
+
     template <typename... Args> static Task<std::unique_ptr<T>> make_component(Args&&... args)
     {
         auto c = std::make_unique<T>(std::forward<Args>(args)...);
+        if constexpr (ComponentInitWorkConcept<T>)
+        {
+            if (auto* batch = ComponentBatch::current())
+            {
+                c->initWork(*batch);
+                co_await batch->wait();
+                co_return c;
+            }
+        }
         if constexpr (ComponentInitConcept<T>)
         {
             co_await c->init();
@@ -76,8 +282,18 @@ public:
     }
 
 protected:
-    Component(Entity* _entity, Engine* _engine) : entity(_entity), engine(_engine) {}
-    Entity* entity;
+    Component(Entity* _entity, Engine* _engine) : entity(_entity ? _entity->getHandle() : EntityHandle{}), engine(_engine) {}
+    auto& hot()
+        requires ComponentHotDataConcept<T>
+    {
+        return ComponentPool<T>::hot(static_cast<T*>(this));
+    }
+    const auto& hot() const
+        requires ComponentHotDataConcept<T>
+    {
+        return ComponentPool<T>::hot(static_cast<const T*>(this));
+    }
+    EntityHandle entity;
     Engine* engine;
     bool _remove{false};
 };
@@ -98,18 +314,25 @@ public:
                 runner = std::make_unique<ComponentRunner<T>>();
                 if constexpr (ComponentInputConcept<T>)
                     component_input_runners.push_back(runner.get());
+                runner_graph_dirty = true;
             }
         }
         return static_cast<ComponentRunner<T>*>(runner.get())->addComponent(std::move(com));
     }
 
     void removeComponents(Entity* entity)
+    {
+        auto handle = entity->getHandle();
+        removeEntities({&handle, 1});
+    }
+
+    void removeEntities(std::span<const EntityHandle> entities)
     {
         for (const auto& [priority, runners] : component_runners)
         {
             for (const auto& [id, runner] : runners)
             {
-                runner->remove(entity);
+                runner->remove(entities);
             }
         }
     }
@@ -120,24 +343,55 @@ public:
         {
             std::ranges::for_each(runners, [](auto& c) { c.second->move_new_components(); });
         }
-        for (const auto& [priority, runners] : component_runners)
+        if (runner_graph_dirty.exchange(false))
+            buildRunnerGraph();
+        if (runner_graph.empty())
+            co_return;
+
+        // each runner starts as soon as all of the runners it depends on have finished
+        RunState state{runner_graph.size()};
+        for (size_t i = 0; i < runner_graph.size(); ++i)
         {
-            std::vector<Task<>> tasks;
-            tasks.reserve(runners.size());
-            std::ranges::for_each(runners, [&tasks, time, elapsed, this](auto& c) { tasks.push_back(c.second->run(engine, time, elapsed)); });
-            for (auto& task : tasks)
+            state.remaining[i] = runner_graph[i].predecessor_count;
+        }
+        {
+            CoroutineAllocator::ArenaScope arena;
+            for (size_t i = 0; i < runner_graph.size(); ++i)
             {
-                co_await task;
-            };
+                if (runner_graph[i].predecessor_count == 0)
+                    state.tasks[i] = runNode(i, state, time, elapsed);
+            }
         }
+        co_await state.join.wait();
     }
 
-    template <ComponentConcept T> T* getComponent(Entity* entity)
+    // step the components by one tick - simulate() only touches its own component, so the runners aren't ordered.
+    //  runners (and components) added since the last run() start simulating once it has picked them up
+    Task<> simulate(time_point time, duration elapsed)
+    {
+        std::vector<Task<>> tasks;
+        tasks.reserve(runner_graph.size());
+        for (auto& node : runner_graph)
+        {
+            tasks.push_back(node.runner->simulate(time, elapsed));
+        }
+        for (auto& task : tasks)
+        {
+            co_await task;
+        }
+    }
+
+    template <ComponentConcept T> T* getComponent(Entity* entity) { return getComponent<T>(entity->getHandle()); }
+
+    template <ComponentConcept T> T* getComponent(EntityHandle entity)
     {
         auto& runner = component_runners[T::priority][T::TypeID()];
         return static_cast<ComponentRunner<T>*>(runner.get())->getComponent(entity);
     }
 
+    // returns nullptr if the component has since been destroyed
+    template <ComponentConcept T> T* getComponent(ComponentHandle<T> handle) { return ComponentPool<T>::get(handle); }
+
     void handleInput(Input* input, const SDL_Event& event)
     {
         for (auto& c : component_input_runners)
@@ -153,7 +407,11 @@ private:
     public:
         virtual void move_new_components() = 0;
         virtual Task<> run(Engine* engine, time_point time, duration elapsed) = 0;
-        virtual void remove(Entity* entity) = 0;
+        virtual Task<> simulate(time_point time, duration elapsed) = 0;
+        virtual uint32_t typeID() const = 0;
+        virtual std::vector<uint32_t> predecessors() const = 0;
+        virtual std::vector<uint32_t> successors() const = 0;
+        virtual void remove(std::span<const EntityHandle> entities) = 0;
         virtual bool handleInput(Input* input, const SDL_Event& event) = 0;
         virtual ~ComponentRunnerInterface() {}
     };
@@ -164,34 +422,87 @@ private:
         T* addComponent(std::unique_ptr<T>&& component)
         {
             auto component_ref = component.get();
-            new_components.queue(std::move(component));
+            if (auto* batch = ComponentBatch::current())
+                batch->defer(new_components, std::move(component));
+            else
+                new_components.queue(std::move(component));
             return component_ref;
         }
+        virtual uint32_t typeID() const override { return T::TypeID(); }
+        virtual std::vector<uint32_t> predecessors() const override
+        {
+            std::vector<uint32_t> ids;
+            T::order::predecessors(ids);
+            return ids;
+        }
+        virtual std::vector<uint32_t> successors() const override
+        {
+            std::vector<uint32_t> ids;
+            T::order::successors(ids);
+            return ids;
+        }
         virtual void move_new_components() override
         {
-            auto components_to_add = new_components.getAll();
+            auto components_to_add = new_components.drain();
+            if (components_to_add.empty())
+                return;
+            components.reserve(components.size() + components_to_add.size());
+            for (const auto& c : components_to_add)
+            {
+                linkComponent(c.get());
+            }
             std::ranges::move(components_to_add, std::back_inserter(components));
+            // keep the components in pool order, so ticking them walks each chunk front to back
+            std::ranges::sort(components, std::less{}, [](const auto& c) { return c.get(); });
         }
         virtual Task<> run(Engine* engine, time_point time, duration elapsed) override
         {
-            if constexpr (ComponentTickConcept<T>)
-            {
-                std::vector<decltype(std::declval<T>().tick(time_point{}, duration{}))> tasks;
-                tasks.reserve(components.size());
-                std::ranges::for_each(components,
-                                      [&tasks, time, elapsed](auto& c)
-                                      {
-                                          if (!c->removed())
-                                              tasks.push_back(c->tick(time, elapsed));
-                                      });
-                for (auto& task : tasks)
+            if constexpr (ComponentUpdateConcept<T> || ComponentUpdateAllConcept<T> || ComponentTickConcept<T>)
+            {
+                constexpr size_t chunk_size = TickChunkSize<T>::value;
+                const size_t chunk_count = (components.size() + chunk_size - 1) / chunk_size;
+                if constexpr (ComponentStageConcept<T>)
+                    stage.begin(engine, components);
+                if (chunk_count > 0)
                 {
-                    co_await task;
-                };
+                    std::span<std::unique_ptr<T>> all_components{components};
+                    AsyncJoin join{chunk_count - 1};
+                    std::vector<WorkerTask<>> chunks;
+                    chunks.reserve(chunk_count - 1);
+                    {
+                        // every chunk is joined before the runner finishes, so their frames can come from the arena
+                        CoroutineAllocator::ArenaScope arena;
+                        for (size_t i = 1; i < chunk_count; ++i)
+                        {
+                            chunks.push_back(tickChunk(all_components.subspan(i * chunk_size, std::min(chunk_size, components.size() - i * chunk_size)),
+                                                       time, elapsed, join));
+                        }
+                    }
+                    // the first chunk runs here instead of being scheduled
+                    try
+                    {
+                        auto first_chunk = all_components.first(std::min(chunk_size, components.size()));
+                        updateRange(first_chunk, time, elapsed);
+                        if constexpr (ComponentTickConcept<T>)
+                            co_await tickRange(first_chunk, time, elapsed);
+                    }
+                    catch (...)
+                    {
+                        join.fail(std::current_exception());
+                    }
+                    co_await join.wait();
+                }
+                if constexpr (ComponentStageConcept<T>)
+                    stage.end(engine, components);
             }
             auto part = std::ranges::partition(components, [](auto& c) { return !c->removed(); });
             if (std::ranges::begin(part) != std::ranges::end(part))
             {
+                std::span<std::unique_ptr<T>> live_components{components.begin(), std::ranges::begin(part)};
+                for (const auto& c : part)
+                {
+                    unlinkComponent(c.get(), live_components);
+                }
                 std::vector<typename decltype(components)::value_type> removed_elements(std::make_move_iterator(std::ranges::begin(part)),
                                                                                         std::make_move_iterator(std::ranges::end(part)));
                 components.erase(std::ranges::begin(part), std::ranges::end(part));
@@ -199,13 +510,57 @@ private:
             }
             co_return;
         }
-        virtual void remove(Entity* entity) override
+        virtual Task<> simulate(time_point time, duration elapsed) override
         {
-            for (auto& c : components)
+            if constexpr (ComponentSimulateConcept<T>)
             {
-                if (c->getEntity() == entity)
+                constexpr size_t chunk_size = TickChunkSize<T>::value;
+                const size_t chunk_count = (components.size() + chunk_size - 1) / chunk_size;
+                if (chunk_count > 0)
                 {
-                    c->remove();
+                    std::span<std::unique_ptr<T>> all_components{components};
+                    AsyncJoin join{chunk_count - 1};
+                    std::vector<WorkerTask<>> chunks;
+                    chunks.reserve(chunk_count - 1);
+                    {
+                        CoroutineAllocator::ArenaScope arena;
+                        for (size_t i = 1; i < chunk_count; ++i)
+                        {
+                            chunks.push_back(simulateChunk(all_components.subspan(i * chunk_size, std::min(chunk_size, components.size() - i * chunk_size)),
+                                                           time, elapsed, join));
+                        }
+                    }
+                    try
+                    {
+                        simulateRange(all_components.first(std::min(chunk_size, components.size())), time, elapsed);
+                    }
+                    catch (...)
+                    {
+                        join.fail(std::current_exception());
+                    }
+                    co_await join.wait();
+                }
+            }
+            co_return;
+        }
+        virtual void remove(std::span<const EntityHandle> entities) override
+        {
+            for (auto entity : entities)
+            {
+                auto* entry = findEntry(entity);
+                if (!entry)
+                    continue;
+                if (entry->count == 1)
+                {
+                    entry->component->remove();
+                }
+                else
+                {
+                    for (auto& c : components)
+                    {
+                        if (c->getEntityHandle() == entity)
+                            c->remove();
+                    }
                 }
             }
         }
@@ -221,22 +576,246 @@ private:
             }
             return false;
         }
-        T* getComponent(Entity* entity)
+        T* getComponent(EntityHandle entity)
         {
-            auto c = std::ranges::find_if(components, [entity](auto& c) { return c->getEntity() == entity; });
-            if (c != components.end())
-                return c->get();
+            if (auto* entry = findEntry(entity))
+                return entry->component;
             return nullptr;
         }
 
     private:
-        SharedLinkedList<std::unique_ptr<T>> new_components;
+        // sparse set from an entity's handle index to its components in this runner
+        //  an entity can have more than one component of a type - the entry points at one of them, and the rare
+        //  operations that need all of them fall back to scanning
+        struct EntityEntry
+        {
+            EntityHandle entity;
+            uint32_t count;
+            T* component;
+        };
+        static constexpr uint32_t no_entry{std::numeric_limits<uint32_t>::max()};
+
+        EntityEntry* findEntry(EntityHandle handle)
+        {
+            if (handle.index >= entity_sparse.size() || entity_sparse[handle.index] == no_entry)
+                return nullptr;
+            auto& entry = entity_dense[entity_sparse[handle.index]];
+            // the index may belong to a newer entity than the one the entry was made for
+            if (entry.entity != handle)
+                return nullptr;
+            return &entry;
+        }
+
+        void linkComponent(T* component)
+        {
+            auto entity = component->getEntityHandle();
+            if (!entity)
+                return;
+            if (auto* entry = findEntry(entity))
+            {
+                entry->count++;
+                return;
+            }
+            auto index = entity.index;
+            if (index >= entity_sparse.size())
+                entity_sparse.resize(std::max<size_t>(index + 1, entity_sparse.size() * 2), no_entry);
+            // still held by an entity that was destroyed without its components being unlinked first
+            if (entity_sparse[index] != no_entry)
+                eraseEntry(index);
+            entity_sparse[index] = static_cast<uint32_t>(entity_dense.size());
+            entity_dense.push_back({.entity = entity, .count = 1, .component = component});
+        }
+
+        void eraseEntry(uint32_t entity_index)
+        {
+            auto dense_index = entity_sparse[entity_index];
+            entity_sparse[entity_index] = no_entry;
+            if (dense_index != entity_dense.size() - 1)
+            {
+                entity_dense[dense_index] = entity_dense.back();
+                entity_sparse[entity_dense[dense_index].entity.index] = dense_index;
+            }
+            entity_dense.pop_back();
+        }
+
+        // live_components are the components that are staying in the runner
+        void unlinkComponent(T* component, std::span<std::unique_ptr<T>> live_components)
+        {
+            auto entity = component->getEntityHandle();
+            if (!entity)
+                return;
+            auto* entry = findEntry(entity);
+            if (!entry)
+                return;
+            if (--entry->count > 0)
+            {
+                if (entry->component == component)
+                {
+                    auto c = std::ranges::find(live_components, entity, [](const auto& c) { return c->getEntityHandle(); });
+                    entry->component = c != live_components.end() ? c->get() : nullptr;
+                }
+                return;
+            }
+            eraseEntry(entry->entity.index);
+        }
+
+        static void updateRange(std::span<std::unique_ptr<T>> range, time_point time, duration elapsed)
+        {
+            if constexpr (ComponentUpdateAllConcept<T>)
+            {
+                if (!range.empty())
+                    T::updateAll(range, time, elapsed);
+            }
+            else if constexpr (ComponentUpdateConcept<T>)
+            {
+                for (auto& c : range)
+                {
+                    if (!c->removed())
+                        c->update(time, elapsed);
+                }
+            }
+        }
+
+        static Task<> tickRange(std::span<std::unique_ptr<T>> range, time_point time, duration elapsed)
+        {
+            std::vector<decltype(std::declval<T>().tick(time_point{}, duration{}))> tasks;
+            tasks.reserve(range.size());
+            {
+                CoroutineAllocator::ArenaScope arena;
+                for (auto& c : range)
+                {
+                    if (!c->removed())
+                        tasks.push_back(c->tick(time, elapsed));
+                }
+            }
+            for (auto& task : tasks)
+            {
+                co_await task;
+            }
+        }
+
+        static void simulateRange(std::span<std::unique_ptr<T>> range, time_point time, duration elapsed)
+        {
+            for (auto& c : range)
+            {
+                if (!c->removed())
+                    c->simulate(time, elapsed);
+            }
+        }
+
+        static WorkerTask<> simulateChunk(std::span<std::unique_ptr<T>> range, time_point time, duration elapsed, AsyncJoin& join)
+        {
+            try
+            {
+                simulateRange(range, time, elapsed);
+            }
+            catch (...)
+            {
+                join.fail(std::current_exception());
+            }
+            co_await join.arrive();
+        }
+
+        static WorkerTask<> tickChunk(std::span<std::unique_ptr<T>> range, time_point time, duration elapsed, AsyncJoin& join)
+        {
+            try
+            {
+                updateRange(range, time, elapsed);
+                if constexpr (ComponentTickConcept<T>)
+                    co_await tickRange(range, time, elapsed);
+            }
+            catch (...)
+            {
+                join.fail(std::current_exception());
+            }
+            co_await join.arrive();
+        }
+
+        LockedQueue<std::unique_ptr<T>> new_components;
         std::vector<std::unique_ptr<T>> components;
+        [[no_unique_address]] typename StageOf<T>::type stage;
+        std::vector<uint32_t> entity_sparse;
+        std::vector<EntityEntry> entity_dense;
+    };
+
+    struct RunnerNode
+    {
+        ComponentRunnerInterface* runner;
+        std::vector<size_t> successors;
+        size_t predecessor_count{0};
     };
 
+    struct RunState
+    {
+        explicit RunState(size_t count) : join(count), remaining(count), tasks(count) {}
+        AsyncJoin join;
+        std::vector<std::atomic<size_t>> remaining;
+        std::vector<std::optional<WorkerTask<>>> tasks;
+    };
+
+    void buildRunnerGraph()
+    {
+        std::lock_guard lg(runner_add_mutex);
+        runner_graph.clear();
+        std::unordered_map<uint32_t, size_t> node_index;
+        for (const auto& [priority, runners] : component_runners)
+        {
+            for (const auto& [id, runner] : runners)
+            {
+                if (runner)
+                {
+                    node_index[id] = runner_graph.size();
+                    runner_graph.push_back({.runner = runner.get()});
+                }
+            }
+        }
+        auto add_edge = [this](size_t from, size_t to)
+        {
+            auto& successors = runner_graph[from].successors;
+            if (std::ranges::find(successors, to) == successors.end())
+            {
+                successors.push_back(to);
+                runner_graph[to].predecessor_count++;
+            }
+        };
+        for (size_t i = 0; i < runner_graph.size(); ++i)
+        {
+            for (auto id : runner_graph[i].runner->predecessors())
+            {
+                if (auto it = node_index.find(id); it != node_index.end())
+                    add_edge(it->second, i);
+            }
+            for (auto id : runner_graph[i].runner->successors())
+            {
+                if (auto it = node_index.find(id); it != node_index.end())
+                    add_edge(i, it->second);
+            }
+        }
+    }
+
+    WorkerTask<> runNode(size_t node, RunState& state, time_point time, duration elapsed)
+    {
+        try
+        {
+            co_await runner_graph[node].runner->run(engine, time, elapsed);
+        }
+        catch (...)
+        {
+            state.join.fail(std::current_exception());
+        }
+        for (auto successor : runner_graph[node].successors)
+        {
+            if (state.remaining[successor].fetch_sub(1, std::memory_order::acq_rel) == 1)
+                state.tasks[successor] = runNode(successor, state, time, elapsed);
+        }
+        co_await state.join.arrive();
+    }
+
     std::mutex runner_add_mutex;
     std::map<int, std::map<uint32_t, std::unique_ptr<ComponentRunnerInterface>>> component_runners;
     std::vector<ComponentRunnerInterface*> component_input_runners;
+    std::atomic<bool> runner_graph_dirty{false};
+    std::vector<RunnerNode> runner_graph;
     Engine* engine;
 };
 } // namespace Component
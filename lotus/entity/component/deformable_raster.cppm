@@ -44,31 +44,18 @@ DeformableRasterComponent::DeformableRasterComponent(Entity* _entity, Engine* _e
 
 WorkerTask<> DeformableRasterComponent::tick(time_point time, duration elapsed)
 {
-    uint32_t command_buffer_count = 0;
     if (engine->renderer->rasterizer)
-        command_buffer_count++;
-    if (engine->renderer->shadowmap_rasterizer)
-        command_buffer_count++;
-    if (command_buffer_count > 0)
     {
-        vk::CommandBufferAllocateInfo alloc_info{
-            .commandPool = *engine->renderer->graphics_pool, .level = vk::CommandBufferLevel::ePrimary, .commandBufferCount = command_buffer_count};
-
-        auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique(alloc_info);
-
-        if (engine->renderer->rasterizer)
-        {
-            drawModelsToBuffer(*command_buffers[0]);
-            engine->worker_pool->command_buffers.graphics_secondary.queue(*command_buffers[0]);
-        }
-
-        if (engine->renderer->shadowmap_rasterizer)
-        {
-            drawShadowmapsToBuffer(*command_buffers[1]);
-            engine->worker_pool->command_buffers.shadowmap.queue(*command_buffers[1]);
-        }
+        auto command_buffer = engine->renderer->getTransientCommandBuffer();
+        drawModelsToBuffer(command_buffer);
+        engine->worker_pool->command_buffers.graphics_secondary.queue(command_buffer);
+    }
 
-        engine->worker_pool->gpuResource(std::move(command_buffers));
+    if (engine->renderer->shadowmap_rasterizer)
+    {
+        auto command_buffer = engine->renderer->getTransientCommandBuffer();
+        drawShadowmapsToBuffer(command_buffer);
+        engine->worker_pool->command_buffers.shadowmap.queue(command_buffer);
     }
     co_return;
 }
@@ -1,8 +1,11 @@
 module;
 
 #include <algorithm>
+#include <array>
 #include <coroutine>
+#include <cstdint>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <vulkan/vulkan.h>
@@ -15,6 +18,7 @@ import :entity.component.deformed_mesh;
 import :entity.component.render_base;
 import :renderer.memory;
 import :renderer.raytrace_query;
+import :renderer.vulkan.renderer;
 import :util;
 import glm;
 import vulkan_hpp;
@@ -42,6 +46,8 @@ protected:
     const DeformedMeshComponent& mesh_component;
     const RenderBaseComponent& base_component;
     std::vector<ModelAccelerationStructures> acceleration_structures;
+    // DeformedMeshComponent::getSkinGeneration each frame's acceleration structures were last updated for
+    std::array<uint64_t, Renderer::getFrameCount()> updated_generation;
 
     ModelAccelerationStructures initModelWork(vk::CommandBuffer command_buffer, const DeformedMeshComponent::ModelInfo& model_info) const;
 };
@@ -50,6 +56,7 @@ DeformableRaytraceComponent::DeformableRaytraceComponent(Entity* _entity, Engine
                                                          const RenderBaseComponent& _base_component)
     : Component(_entity, _engine), mesh_component(_mesh_component), base_component(_base_component)
 {
+    updated_generation.fill(std::numeric_limits<uint64_t>::max());
 }
 
 WorkerTask<> DeformableRaytraceComponent::init()
@@ -164,20 +171,21 @@ DeformableRaytraceComponent::ModelAccelerationStructures DeformableRaytraceCompo
 
 Task<> DeformableRaytraceComponent::tick(time_point time, duration delta)
 {
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique({
-        .commandPool = *engine->renderer->graphics_pool,
-        .level = vk::CommandBufferLevel::ePrimary,
-        .commandBufferCount = 1,
-    });
-
-    auto command_buffer = std::move(command_buffers[0]);
-
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
     auto models = mesh_component.getModels();
     uint32_t current_frame = engine->renderer->getCurrentFrame();
     uint32_t prev_frame = engine->renderer->getPreviousFrame();
 
+    // the vertex buffers weren't reskinned, so the acceleration structures built from them still match
+    const auto generation = mesh_component.getSkinGeneration(current_frame);
+    const bool update = updated_generation[current_frame] != generation;
+    vk::CommandBuffer command_buffer;
+    if (update)
+    {
+        command_buffer = engine->renderer->getTransientCommandBuffer();
+        command_buffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        updated_generation[current_frame] = generation;
+    }
+
     for (size_t i = 0; i < models.size(); ++i)
     {
         const auto& model = models[i].model;
@@ -185,7 +193,8 @@ Task<> DeformableRaytraceComponent::tick(time_point time, duration delta)
 
         if (as)
         {
-            as->Update(*command_buffer);
+            if (update)
+                as->Update(command_buffer);
 
             if (auto tlas = engine->renderer->raytracer->getTLAS(current_frame))
             {
@@ -202,15 +211,18 @@ Task<> DeformableRaytraceComponent::tick(time_point time, duration delta)
         }
     }
 
-    command_buffer->end();
-    engine->worker_pool->command_buffers.graphics_primary.queue(*command_buffer);
-    engine->worker_pool->gpuResource(std::move(command_buffer));
+    if (update)
+    {
+        command_buffer.end();
+        engine->worker_pool->command_buffers.graphics_primary.queue(command_buffer);
+    }
     co_return;
 }
 
 void DeformableRaytraceComponent::replaceModelIndex(ModelAccelerationStructures&& acceleration, uint32_t index)
 {
     std::swap(acceleration_structures[index], acceleration);
+    updated_generation.fill(std::numeric_limits<uint64_t>::max());
 
     engine->worker_pool->gpuResource(std::move(acceleration));
 }
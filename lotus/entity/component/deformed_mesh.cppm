@@ -1,6 +1,10 @@
 module;
 
+#include <algorithm>
+#include <array>
 #include <coroutine>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <span>
 #include <vector>
@@ -14,20 +18,23 @@ import :entity.component.render_base;
 import :renderer.memory;
 import :renderer.model;
 import :renderer.vulkan.common.global_descriptors;
+import :renderer.vulkan.renderer;
+import :renderer.vulkan.upload_ring;
 import :util;
 import glm;
 import vulkan_hpp;
 
 export namespace lotus::Component
 {
-class DeformedMeshComponent : public Component<DeformedMeshComponent, After<RenderBaseComponent>>
+class DeformedMeshComponent : public Component<DeformedMeshComponent, After<RenderBaseComponent, AnimationComponent>>
 {
 public:
     explicit DeformedMeshComponent(Entity*, Engine* engine, const RenderBaseComponent& base_component, const AnimationComponent& animation_component,
                                    std::vector<std::shared_ptr<Model>> models);
 
     WorkerTask<> init();
-    WorkerTask<> tick(time_point time, duration elapsed);
+    void initWork(ComponentBatch& batch);
+    void update(time_point time, duration elapsed);
 
     struct ModelInfo
     {
@@ -43,19 +50,57 @@ public:
     std::span<const ModelInfo> getModels() const;
     WorkerTask<ModelInfo> initModel(std::shared_ptr<Model> model) const;
     void replaceModelIndex(ModelInfo&& transform, uint32_t index);
+    // changes whenever a frame's vertex buffers are skinned, so acceleration structures built from them can tell when
+    //  they're already up to date
+    uint64_t getSkinGeneration(uint32_t frame) const { return skinned_generation[frame]; }
+
+    // Skins the meshes of every component together
+    //  components only decide whether their pose has changed as they update; afterwards each of their meshes gets an
+    //  entry in one dispatch table, and the batched kernel runs over all of the vertices listed in it, followed by a
+    //  single barrier for the whole scene
+    class Stage
+    {
+    public:
+        void begin(Engine*, std::span<std::unique_ptr<DeformedMeshComponent>>) {}
+        void end(Engine* engine, std::span<std::unique_ptr<DeformedMeshComponent>> components);
+
+    private:
+        // matches SkinDispatch in animation_skin.slang
+        struct SkinDispatch
+        {
+            vk::DeviceAddress weights;
+            vk::DeviceAddress vertices;
+            uint32_t first_bone;
+            uint32_t first_vertex;
+            uint32_t vertex_count;
+            uint32_t padding;
+        };
+        static constexpr uint32_t workgroup_size{64};
+        std::vector<SkinDispatch> dispatches;
+    };
 
 protected:
     const RenderBaseComponent& base_component;
     const AnimationComponent& animation_component;
     std::vector<ModelInfo> models;
 
+    static constexpr uint64_t not_skinned{std::numeric_limits<uint64_t>::max()};
+    // the pose each frame's vertex buffers were last skinned with
+    std::array<uint64_t, Renderer::getFrameCount()> skinned_pose;
+    std::array<uint64_t, Renderer::getFrameCount()> skinned_generation{};
+    uint64_t skin_count{0};
+    // whether the stage skins this frame's vertex buffers
+    bool skin_pending{false};
+
     ModelInfo initModelWork(vk::CommandBuffer command_buffer, std::shared_ptr<Model> model) const;
+    void updateMeshInfos(uint32_t current_frame, uint32_t previous_frame);
 };
 
 DeformedMeshComponent::DeformedMeshComponent(Entity* _entity, Engine* _engine, const RenderBaseComponent& _base_component,
                                              const AnimationComponent& _animation_component, std::vector<std::shared_ptr<Model>> _models)
     : Component(_entity, _engine), base_component(_base_component), animation_component(_animation_component)
 {
+    skinned_pose.fill(not_skinned);
     for (const auto& model : _models)
     {
         models.push_back({.model = model});
@@ -64,28 +109,20 @@ DeformedMeshComponent::DeformedMeshComponent(Entity* _entity, Engine* _engine, c
 
 WorkerTask<> DeformedMeshComponent::init()
 {
-    vk::CommandBufferAllocateInfo alloc_info;
-
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique({
-        .commandPool = *engine->renderer->compute_pool,
-        .level = vk::CommandBufferLevel::ePrimary,
-        .commandBufferCount = 1,
-    });
-    auto command_buffer = std::move(command_buffers[0]);
-
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    ComponentBatch batch{engine};
+    initWork(batch);
+    co_await batch.finish();
+}
 
+void DeformedMeshComponent::initWork(ComponentBatch& batch)
+{
     for (auto& model : models)
     {
         if (model.model->weighted)
         {
-            model = initModelWork(*command_buffer, model.model);
+            model = initModelWork(batch.commandBuffer(), model.model);
         }
     }
-    command_buffer->end();
-    co_await engine->renderer->async_compute->compute(std::move(command_buffer));
-
-    co_return;
 }
 
 DeformedMeshComponent::ModelInfo DeformedMeshComponent::initModelWork(vk::CommandBuffer command_buffer, std::shared_ptr<Model> model) const
@@ -131,8 +168,8 @@ DeformedMeshComponent::ModelInfo DeformedMeshComponent::initModelWork(vk::Comman
         info.vertex_buffers.push_back(std::move(new_vertex_buffer));
     }
 
-    // TODO: transform with a default t-pose instead of current animation to improve acceleration structure build
-    // make sure all vertex and index buffers are finished transferring
+    // skinned with the rest pose, which (like the vertex and index buffers) was uploaded by an earlier submission
+    //  - make sure those transfers are finished
     vk::MemoryBarrier2 barrier{.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
                                   .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
                                   .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
@@ -140,14 +177,11 @@ DeformedMeshComponent::ModelInfo DeformedMeshComponent::initModelWork(vk::Comman
 
     command_buffer.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
 
-    auto& skeleton = animation_component.skeleton;
     command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_pipeline);
 
     for (uint32_t current_frame = 0; current_frame < engine->renderer->getFrameCount(); ++current_frame)
     {
-        vk::DescriptorBufferInfo skeleton_buffer_info{.buffer = animation_component.skeleton_bone_buffer->buffer,
-                                                      .offset = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size() * current_frame,
-                                                      .range = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size()};
+        vk::DescriptorBufferInfo skeleton_buffer_info = animation_component.getRestPoseBuffer();
 
         vk::WriteDescriptorSet skeleton_descriptor_set{.dstSet = nullptr,
                                                        .dstBinding = 1,
@@ -204,23 +238,68 @@ DeformedMeshComponent::ModelInfo DeformedMeshComponent::initModelWork(vk::Comman
     return info;
 }
 
-WorkerTask<> DeformedMeshComponent::tick(time_point time, duration elapsed)
+void DeformedMeshComponent::update(time_point time, duration elapsed)
 {
-    auto& skeleton = animation_component.skeleton;
     auto current_frame = engine->renderer->getCurrentFrame();
     auto previous_frame = engine->renderer->getPreviousFrame();
 
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique(
-        {.commandPool = *engine->renderer->graphics_pool, .level = vk::CommandBufferLevel::ePrimary, .commandBufferCount = 1});
-    auto command_buffer = std::move(command_buffers[0]);
+    // unless the pose hasn't changed since this frame's vertex buffers were last skinned (the skeleton is frozen or
+    //  between LOD updates), in which case they can be drawn and traced as they are
+    const auto pose_version = animation_component.getPoseVersion();
+    skin_pending = skinned_pose[current_frame] != pose_version;
+    if (skin_pending)
+    {
+        skinned_pose[current_frame] = pose_version;
+        skinned_generation[current_frame] = ++skin_count;
+    }
+    updateMeshInfos(current_frame, previous_frame);
+}
 
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+void DeformedMeshComponent::Stage::end(Engine* engine, std::span<std::unique_ptr<DeformedMeshComponent>> components)
+{
+    const auto current_frame = engine->renderer->getCurrentFrame();
+    const auto& device = engine->renderer->gpu->device;
+
+    dispatches.clear();
+    uint32_t vertex_count = 0;
+    vk::Buffer bone_buffer;
+    for (auto& component : components)
+    {
+        if (component->removed() || !component->skin_pending)
+            continue;
+        const auto first_bone = component->animation_component.getFirstBone();
+        bone_buffer = component->animation_component.getBoneBuffer();
+        for (const auto& model : component->models)
+        {
+            const auto weights = device->getBufferAddress({.buffer = model.model->vertex_buffer->buffer});
+            const auto vertices = device->getBufferAddress({.buffer = model.vertex_buffers[current_frame]->buffer});
+            for (size_t i = 0; i < model.model->meshes.size(); ++i)
+            {
+                const auto& mesh = model.model->meshes[i];
+                const auto mesh_vertex_count = static_cast<uint32_t>(mesh->getVertexCount());
+                dispatches.push_back({.weights = weights + mesh->vertex_offset,
+                                      .vertices = vertices + model.vertex_offsets[i],
+                                      .first_bone = first_bone,
+                                      .first_vertex = vertex_count,
+                                      .vertex_count = mesh_vertex_count});
+                vertex_count += mesh_vertex_count;
+            }
+        }
+    }
+    if (vertex_count == 0)
+        return;
+
+    auto table = engine->renderer->upload_ring->allocateStorage(sizeof(SkinDispatch) * dispatches.size());
+    std::ranges::copy(dispatches, table.as<SkinDispatch>());
 
-    command_buffer->bindPipeline(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_pipeline);
+    auto command_buffer = engine->renderer->getTransientCommandBuffer();
 
-    vk::DescriptorBufferInfo skeleton_buffer_info{.buffer = animation_component.skeleton_bone_buffer->buffer,
-                                                  .offset = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size() * current_frame,
-                                                  .range = sizeof(AnimationComponent::BufferBone) * skeleton->bones.size()};
+    command_buffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_batch_pipeline);
+
+    vk::DescriptorBufferInfo skeleton_buffer_info{.buffer = bone_buffer, .offset = 0, .range = vk::WholeSize};
+    vk::DescriptorBufferInfo dispatch_buffer_info{.buffer = table.buffer, .offset = table.offset, .range = table.size};
 
     vk::WriteDescriptorSet skeleton_descriptor_set{.dstSet = nullptr,
                                                    .dstBinding = 1,
@@ -229,56 +308,43 @@ WorkerTask<> DeformedMeshComponent::tick(time_point time, duration elapsed)
                                                    .descriptorType = vk::DescriptorType::eStorageBuffer,
                                                    .pBufferInfo = &skeleton_buffer_info};
 
-    command_buffer->pushDescriptorSet(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_pipeline_layout, 0, skeleton_descriptor_set);
-
-    // transform skeleton with current animation
-    for (size_t i = 0; i < models.size(); ++i)
-    {
-        for (size_t j = 0; j < models[i].model->meshes.size(); ++j)
-        {
-            auto& mesh = models[i].model->meshes[j];
-            auto& vertex_buffer = models[i].vertex_buffers[current_frame];
-            auto vertex_buffer_size = models[i].vertex_sizes[j];
-            auto vertex_buffer_offset = models[i].vertex_offsets[j];
-
-            vk::DescriptorBufferInfo vertex_weights_buffer_info{
-                .buffer = models[i].model->vertex_buffer->buffer, .offset = mesh->vertex_offset, .range = mesh->vertex_size};
-
-            vk::DescriptorBufferInfo vertex_output_buffer_info{.buffer = vertex_buffer->buffer, .offset = vertex_buffer_offset, .range = vertex_buffer_size};
-
-            vk::WriteDescriptorSet weight_descriptor_set{
-                .dstSet = nullptr,
-                .dstBinding = 0,
-                .dstArrayElement = 0,
-                .descriptorCount = 1,
-                .descriptorType = vk::DescriptorType::eStorageBuffer,
-                .pBufferInfo = &vertex_weights_buffer_info,
-            };
+    vk::WriteDescriptorSet dispatch_descriptor_set{.dstSet = nullptr,
+                                                   .dstBinding = 3,
+                                                   .dstArrayElement = 0,
+                                                   .descriptorCount = 1,
+                                                   .descriptorType = vk::DescriptorType::eStorageBuffer,
+                                                   .pBufferInfo = &dispatch_buffer_info};
 
-            vk::WriteDescriptorSet output_descriptor_set{.dstSet = nullptr,
-                                                         .dstBinding = 2,
-                                                         .dstArrayElement = 0,
-                                                         .descriptorCount = 1,
-                                                         .descriptorType = vk::DescriptorType::eStorageBuffer,
-                                                         .pBufferInfo = &vertex_output_buffer_info};
+    command_buffer.pushDescriptorSet(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_pipeline_layout, 0,
+                                     {skeleton_descriptor_set, dispatch_descriptor_set});
 
-            command_buffer->pushDescriptorSet(vk::PipelineBindPoint::eCompute, *engine->renderer->animation_pipeline_layout, 0,
-                                                 {weight_descriptor_set, output_descriptor_set});
+    // a single dispatch, unless there are more vertices than one can have workgroups for
+    const uint32_t max_workgroups = std::min(engine->renderer->gpu->properties.properties.limits.maxComputeWorkGroupCount[0],
+                                             std::numeric_limits<uint32_t>::max() / workgroup_size);
+    for (uint32_t vertex_base = 0; vertex_base < vertex_count; vertex_base += max_workgroups * workgroup_size)
+    {
+        const std::array<uint32_t, 2> push_constants{static_cast<uint32_t>(dispatches.size()), vertex_base};
+        command_buffer.pushConstants<uint32_t>(*engine->renderer->animation_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, push_constants);
+        command_buffer.dispatch(std::min(max_workgroups, (vertex_count - vertex_base + workgroup_size - 1) / workgroup_size), 1, 1);
+    }
 
-            command_buffer->dispatch(mesh->getVertexCount(), 1, 1);
+    vk::MemoryBarrier2 barrier{.srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+                               .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
+                               .dstStageMask = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+                               .dstAccessMask = vk::AccessFlagBits2::eAccelerationStructureWriteKHR | vk::AccessFlagBits2::eAccelerationStructureReadKHR};
 
-            vk::BufferMemoryBarrier2 barrier{.srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
-                                                .srcAccessMask = vk::AccessFlagBits2::eShaderWrite,
-                                                .dstStageMask = vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
-                                                .dstAccessMask =
-                                                    vk::AccessFlagBits2::eAccelerationStructureWriteKHR | vk::AccessFlagBits2::eAccelerationStructureReadKHR,
-                                                .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
-                                                .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
-                                                .buffer = vertex_buffer->buffer,
-                                                .size = vk::WholeSize};
+    command_buffer.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+    command_buffer.end();
 
-            command_buffer->pipelineBarrier2({.bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &barrier});
+    engine->worker_pool->command_buffers.graphics_primary.queue(command_buffer);
+}
 
+void DeformedMeshComponent::updateMeshInfos(uint32_t current_frame, uint32_t previous_frame)
+{
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        for (size_t j = 0; j < models[i].model->meshes.size(); ++j)
+        {
             auto current_vertex_buffer = models[i].vertex_buffers[current_frame]->buffer;
             auto prev_vertex_buffer = models[i].vertex_buffers[previous_frame]->buffer;
             auto vertex_offset = models[i].vertex_offsets[j];
@@ -291,11 +357,6 @@ WorkerTask<> DeformedMeshComponent::tick(time_point time, duration elapsed)
             models[i].mesh_infos[current_frame]->buffer_view[j].model_prev = base_component.getPrevModelMatrix();
         }
     }
-    command_buffer->end();
-
-    engine->worker_pool->command_buffers.graphics_primary.queue(*command_buffer);
-    engine->worker_pool->gpuResource(std::move(command_buffer));
-    co_return;
 }
 
 std::span<const DeformedMeshComponent::ModelInfo> DeformedMeshComponent::getModels() const { return models; }
@@ -326,6 +387,7 @@ WorkerTask<DeformedMeshComponent::ModelInfo> DeformedMeshComponent::initModel(st
 void DeformedMeshComponent::replaceModelIndex(ModelInfo&& info, uint32_t index)
 {
     std::swap(models[index], info);
+    skinned_pose.fill(not_skinned);
     engine->worker_pool->gpuResource(std::move(info));
 }
 } // namespace lotus::Component
@@ -1,7 +1,6 @@
 module;
 
 #include <coroutine>
-#include <cstring>
 #include <memory>
 #include <span>
 #include <unordered_map>
@@ -40,6 +39,7 @@ public:
                                       const std::unordered_map<std::string, std::pair<vk::DeviceSize, uint32_t>> instance_offsets);
 
     WorkerTask<> init();
+    void initWork(ComponentBatch& batch);
 
     std::span<const ModelInfo> getModels() const;
     vk::Buffer getInstanceBuffer() const;
@@ -65,36 +65,19 @@ InstancedModelsComponent::InstancedModelsComponent(Entity* _entity, Engine* _eng
 }
 
 WorkerTask<> InstancedModelsComponent::init()
+{
+    ComponentBatch batch{engine};
+    initWork(batch);
+    co_await batch.finish();
+}
+
+void InstancedModelsComponent::initWork(ComponentBatch& batch)
 {
     instance_buffer = engine->renderer->gpu->memory_manager->GetBuffer(sizeof(InstanceInfo) * instances.size(),
                                                                        vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
                                                                        vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-    vk::CommandBufferAllocateInfo alloc_info;
-
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique({
-        .commandPool = *engine->renderer->compute_pool,
-        .level = vk::CommandBufferLevel::ePrimary,
-        .commandBufferCount = 1,
-    });
-    auto command_buffer = std::move(command_buffers[0]);
-
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
-    vk::DeviceSize buffer_size = sizeof(InstanceInfo) * instances.size();
-
-    auto staging_buffer = engine->renderer->gpu->memory_manager->GetBuffer(
-        buffer_size, vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-    void* data = staging_buffer->map(0, buffer_size, {});
-    memcpy(data, instances.data(), buffer_size);
-    staging_buffer->unmap();
-
-    vk::BufferCopy copy_region{.size = buffer_size};
-    command_buffer->copyBuffer(staging_buffer->buffer, instance_buffer->buffer, copy_region);
-
-    command_buffer->end();
-    auto compute = engine->renderer->async_compute->compute(std::move(command_buffer));
+    batch.upload(instance_buffer->buffer, 0, std::as_bytes(std::span{instances}));
 
     for (const auto& model : models)
     {
@@ -117,10 +100,6 @@ WorkerTask<> InstancedModelsComponent::init()
             };
         }
     }
-
-    co_await compute;
-
-    co_return;
 }
 
 std::span<const InstancedModelsComponent::ModelInfo> InstancedModelsComponent::getModels() const { return models; }
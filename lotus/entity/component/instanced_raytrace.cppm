@@ -24,7 +24,7 @@ class InstancedRaytraceComponent : public Component<InstancedRaytraceComponent,
 public:
     explicit InstancedRaytraceComponent(Entity*, Engine* engine, const InstancedModelsComponent& models);
 
-    Task<> tick(time_point time, duration delta);
+    void update(time_point time, duration delta);
 
 protected:
     const InstancedModelsComponent& models_component;
@@ -35,7 +35,7 @@ InstancedRaytraceComponent::InstancedRaytraceComponent(Entity* _entity, Engine*
 {
 }
 
-Task<> InstancedRaytraceComponent::tick(time_point time, duration delta)
+void InstancedRaytraceComponent::update(time_point time, duration delta)
 {
     auto models = models_component.getModels();
 
@@ -62,12 +62,12 @@ Task<> InstancedRaytraceComponent::tick(time_point time, duration delta)
                                                                   .flags = (VkGeometryInstanceFlagsKHR)vk::GeometryInstanceFlagBitsKHR::eTriangleCullDisable,
                                                                   .accelerationStructureReference = as->handle};
                     memcpy(&instance.transform, &matrix, sizeof(matrix));
-                    // ???
-                    as->instanceid = tlas->AddInstance(instance);
+                    // the BLAS is shared by every instance of the model (and ticked concurrently), so there's no single
+                    //  instance id to keep on it
+                    tlas->AddInstance(instance);
                 }
             }
         }
     }
-    co_return;
 }
 } // namespace lotus::Component
@@ -1,5 +1,6 @@
 module;
 
+#include <algorithm>
 #include <chrono>
 #include <coroutine>
 #include <memory>
@@ -21,7 +22,7 @@ class ParticleComponent : public Component<ParticleComponent>
 public:
     explicit ParticleComponent(Entity*, Engine* engine, std::shared_ptr<Model> models);
 
-    Task<> tick(time_point time, duration delta);
+    void update(time_point time, duration delta);
 
     std::pair<std::shared_ptr<Model>, GlobalDescriptors::MeshInfoBuffer::View*> getModel() const;
 
@@ -41,11 +42,12 @@ ParticleComponent::ParticleComponent(Entity* _entity, Engine* _engine, std::shar
 {
 }
 
-Task<> ParticleComponent::tick(time_point time, duration delta)
+void ParticleComponent::update(time_point time, duration delta)
 {
     if (model->meshes[0]->getSpriteCount() > 1)
     {
-        auto diff = time - start_time;
+        // frames are drawn up to a tick behind the simulation time the particle was created at
+        auto diff = std::max(time - start_time, duration{0});
         auto frames = 60.f * ((float)std::chrono::nanoseconds(diff).count() / std::chrono::nanoseconds(1s).count());
         current_sprite = static_cast<size_t>(frames) % model->meshes[0]->getSpriteCount();
     }
@@ -53,8 +55,6 @@ Task<> ParticleComponent::tick(time_point time, duration delta)
     mesh_infos[engine->renderer->getCurrentFrame()]->buffer_view[0].colour = color;
     mesh_infos[engine->renderer->getCurrentFrame()]->buffer_view[0].uv_offset = uv_offset;
     mesh_infos[engine->renderer->getCurrentFrame()]->buffer_view[0].animation_frame = model->animation_frame;
-
-    co_return;
 }
 
 std::pair<std::shared_ptr<Model>, GlobalDescriptors::MeshInfoBuffer::View*> ParticleComponent::getModel() const
@@ -41,23 +41,11 @@ ParticleRasterComponent::ParticleRasterComponent(Entity* _entity, Engine* _engin
 
 WorkerTask<> ParticleRasterComponent::tick(time_point time, duration elapsed)
 {
-    uint32_t command_buffer_count = 0;
     if (engine->renderer->rasterizer)
-        command_buffer_count++;
-    if (command_buffer_count > 0)
     {
-        vk::CommandBufferAllocateInfo alloc_info{
-            .commandPool = *engine->renderer->graphics_pool, .level = vk::CommandBufferLevel::ePrimary, .commandBufferCount = command_buffer_count};
-
-        auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique(alloc_info);
-
-        if (engine->renderer->rasterizer)
-        {
-            drawModelsToBuffer(*command_buffers[0]);
-            engine->worker_pool->command_buffers.particle.queue(*command_buffers[0]);
-        }
-
-        engine->worker_pool->gpuResource(std::move(command_buffers));
+        auto command_buffer = engine->renderer->getTransientCommandBuffer();
+        drawModelsToBuffer(command_buffer);
+        engine->worker_pool->command_buffers.particle.queue(command_buffer);
     }
     co_return;
 }
@@ -41,15 +41,9 @@ Task<> ParticleRaytraceComponent::tick(time_point time, duration delta)
 {
     auto [model, info] = particle_component.getModel();
 
-    auto command_buffers = engine->renderer->gpu->device->allocateCommandBuffersUnique({
-        .commandPool = *engine->renderer->graphics_pool,
-        .level = vk::CommandBufferLevel::ePrimary,
-        .commandBufferCount = 1,
-    });
+    auto command_buffer = engine->renderer->getTransientCommandBuffer();
 
-    auto command_buffer = std::move(command_buffers[0]);
-
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    command_buffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
     uint32_t image = engine->renderer->getCurrentFrame();
     uint32_t prev_image = engine->renderer->getPreviousFrame();
@@ -65,12 +59,11 @@ Task<> ParticleRaytraceComponent::tick(time_point time, duration delta)
                                                       .flags = (VkGeometryInstanceFlagsKHR)vk::GeometryInstanceFlagBitsKHR::eTriangleCullDisable,
                                                       .accelerationStructureReference = model->bottom_level_as->handle};
         memcpy(&instance.transform, &matrix, sizeof(matrix));
-        model->bottom_level_as->instanceid = tlas->AddInstance(instance);
+        tlas->AddInstance(instance);
     }
 
-    command_buffer->end();
-    engine->worker_pool->command_buffers.graphics_primary.queue(*command_buffer);
-    engine->worker_pool->gpuResource(std::move(command_buffer));
+    command_buffer.end();
+    engine->worker_pool->command_buffers.graphics_primary.queue(command_buffer);
     co_return;
 }
 } // namespace lotus::Component
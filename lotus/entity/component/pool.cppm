@@ -0,0 +1,237 @@
+module;
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+export module lotus:entity.component.pool;
+
+export namespace lotus::Component
+{
+// stable reference to a pooled component - stays trivially copyable and can be validated after the component is gone
+template <typename T> struct ComponentHandle
+{
+    uint32_t index{std::numeric_limits<uint32_t>::max()};
+    uint32_t generation{0};
+
+    explicit operator bool() const { return index != std::numeric_limits<uint32_t>::max(); }
+    bool operator==(const ComponentHandle&) const = default;
+};
+
+// components can opt in to hot/cold splitting by declaring a HotData struct: the pool keeps the HotData
+//  of each chunk packed together so that systems can stream over it without touching the rest of the component
+template <typename T>
+concept ComponentHotDataConcept = requires { typename T::HotData; };
+
+namespace detail
+{
+template <typename T> struct HotStorage
+{
+    struct type
+    {
+    };
+};
+template <ComponentHotDataConcept T> struct HotStorage<T>
+{
+    using type = std::array<typename T::HotData, 64>;
+};
+} // namespace detail
+
+// Per-type storage for components
+//  components are constructed in place in fixed-size chunks, so they never move once created (other components
+//  hold references to them) and components of the same type sit next to each other in memory
+template <typename T> class ComponentPool
+{
+    struct Chunk;
+
+public:
+    static constexpr uint32_t slots_per_chunk{64};
+    static constexpr uint32_t max_chunks{4096};
+
+    static void* allocate(size_t size)
+    {
+        if (size != sizeof(T))
+        {
+            // a type derived from T - it doesn't fit in T's slots
+            if constexpr (ComponentHotDataConcept<T>)
+                throw std::invalid_argument("components with HotData cannot be derived from");
+            return ::operator new(size);
+        }
+        return instance().allocateSlot();
+    }
+
+    static void deallocate(void* ptr, size_t size)
+    {
+        if (size != sizeof(T))
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        instance().freeSlot(ptr);
+    }
+
+    static ComponentHandle<T> handle(const T* component)
+    {
+        auto* chunk = chunkOf(component);
+        auto slot = slotOf(chunk, component);
+        return {.index = chunk->index * slots_per_chunk + slot, .generation = chunk->generations[slot].load(std::memory_order::acquire)};
+    }
+
+    // returns nullptr if the component the handle referred to has been destroyed
+    static T* get(ComponentHandle<T> handle)
+    {
+        if (!handle || handle.index >= max_chunks * slots_per_chunk)
+            return nullptr;
+        auto* chunk = instance().chunks[handle.index / slots_per_chunk].load(std::memory_order::acquire);
+        auto slot = handle.index % slots_per_chunk;
+        if (!chunk || !(chunk->live_mask.load(std::memory_order::acquire) & (uint64_t{1} << slot)) ||
+            chunk->generations[slot].load(std::memory_order::acquire) != handle.generation)
+            return nullptr;
+        return std::launder(reinterpret_cast<T*>(chunk->slots[slot].storage));
+    }
+
+    static auto& hot(const T* component)
+        requires ComponentHotDataConcept<T>
+    {
+        auto* chunk = chunkOf(component);
+        return chunk->hot[slotOf(chunk, component)];
+    }
+
+    // one chunk's packed hot data, and which of its slots belong to the components being visited
+    struct HotChunk
+    {
+        std::span<typename T::HotData, slots_per_chunk> hot;
+        uint64_t mask;
+        Chunk* chunk;
+
+        T& component(uint32_t slot) const { return *std::launder(reinterpret_cast<T*>(chunk->slots[slot].storage)); }
+    };
+
+    // visit the packed hot data of a set of components (a runner's, not every component of the type) a chunk at a time
+    //  components should be in address order, as the runners keep them, or a chunk gets visited once per run of its
+    //  components.  only a slot header per chunk is read, not the components, so passes can decide from the hot data alone
+    //  which of them need any more work
+    template <typename F>
+        requires ComponentHotDataConcept<T>
+    static void forEachHotChunk(std::span<const std::unique_ptr<T>> components, F&& func)
+    {
+        Chunk* chunk = nullptr;
+        uint64_t mask = 0;
+        for (const auto& component : components)
+        {
+            if (!chunk || !inChunk(chunk, component.get()))
+            {
+                if (chunk)
+                    func(HotChunk{.hot = chunk->hot, .mask = mask, .chunk = chunk});
+                chunk = chunkOf(component.get());
+                mask = 0;
+            }
+            mask |= uint64_t{1} << slotOf(chunk, component.get());
+        }
+        if (chunk)
+            func(HotChunk{.hot = chunk->hot, .mask = mask, .chunk = chunk});
+    }
+
+private:
+    // each slot points back at its chunk, so the chunk of a component can be found from its address alone
+    struct Slot
+    {
+        Chunk* chunk;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+    struct Chunk
+    {
+        std::array<Slot, slots_per_chunk> slots;
+        // written on free while get() may be validating a handle on another thread
+        std::array<std::atomic<uint32_t>, slots_per_chunk> generations{};
+        std::atomic<uint64_t> live_mask{0};
+        uint32_t index;
+        [[no_unique_address]] typename detail::HotStorage<T>::type hot{};
+    };
+    static_assert(slots_per_chunk == 64, "live_mask and HotStorage assume 64 slots per chunk");
+
+    static ComponentPool& instance()
+    {
+        static ComponentPool pool;
+        return pool;
+    }
+
+    static const Slot* slotHeader(const T* component)
+    {
+        return reinterpret_cast<const Slot*>(reinterpret_cast<const std::byte*>(component) - offsetof(Slot, storage));
+    }
+
+    static Chunk* chunkOf(const T* component) { return slotHeader(component)->chunk; }
+
+    static uint32_t slotOf(const Chunk* chunk, const T* component) { return static_cast<uint32_t>(slotHeader(component) - chunk->slots.data()); }
+
+    // by address alone, without reading the slot header
+    static bool inChunk(const Chunk* chunk, const T* component)
+    {
+        auto address = reinterpret_cast<uintptr_t>(slotHeader(component));
+        auto first = reinterpret_cast<uintptr_t>(chunk->slots.data());
+        return address >= first && address < first + sizeof(chunk->slots);
+    }
+
+    void* allocateSlot()
+    {
+        std::lock_guard lk{mutex};
+        if (free_slots.empty())
+        {
+            auto index = chunk_count.load(std::memory_order::relaxed);
+            if (index == max_chunks)
+                throw std::length_error("ComponentPool is full");
+            auto* chunk = new Chunk{};
+            chunk->index = index;
+            for (auto& slot : chunk->slots)
+                slot.chunk = chunk;
+            chunks[index].store(chunk, std::memory_order::release);
+            chunk_count.store(index + 1, std::memory_order::release);
+            // push in reverse so slots are handed out in address order
+            for (uint32_t slot = slots_per_chunk; slot > 0; --slot)
+                free_slots.push_back(index * slots_per_chunk + slot - 1);
+        }
+        auto index = free_slots.back();
+        free_slots.pop_back();
+        auto* chunk = chunks[index / slots_per_chunk].load(std::memory_order::relaxed);
+        auto slot = index % slots_per_chunk;
+        if constexpr (ComponentHotDataConcept<T>)
+            chunk->hot[slot] = {};
+        chunk->live_mask.fetch_or(uint64_t{1} << slot, std::memory_order::release);
+        return chunk->slots[slot].storage;
+    }
+
+    void freeSlot(void* ptr)
+    {
+        auto* chunk = chunkOf(static_cast<T*>(ptr));
+        auto slot = slotOf(chunk, static_cast<T*>(ptr));
+        std::lock_guard lk{mutex};
+        chunk->live_mask.fetch_and(~(uint64_t{1} << slot), std::memory_order::release);
+        chunk->generations[slot].fetch_add(1, std::memory_order::release);
+        free_slots.push_back(chunk->index * slots_per_chunk + slot);
+    }
+
+    ComponentPool() : chunks(std::make_unique<std::atomic<Chunk*>[]>(max_chunks)) {}
+    ~ComponentPool()
+    {
+        auto count = chunk_count.load(std::memory_order::relaxed);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            delete chunks[i].load(std::memory_order::relaxed);
+        }
+    }
+
+    std::mutex mutex;
+    std::unique_ptr<std::atomic<Chunk*>[]> chunks;
+    std::atomic<uint32_t> chunk_count{0};
+    std::vector<uint32_t> free_slots;
+};
+} // namespace lotus::Component
@@ -1,15 +1,21 @@
 module;
 
+#include <array>
 #include <coroutine>
+#include <cstdint>
+#include <bit>
 #include <memory>
+#include <span>
+#include <tuple>
 
 export module lotus:entity.component.render_base;
 
 import :core.engine;
 import :entity.component;
 import :entity.component.camera;
-import :renderer.memory;
+import :entity.component.pool;
 import :renderer.vulkan.renderer;
+import :renderer.vulkan.upload_ring;
 import :util;
 import glm;
 import vulkan_hpp;
@@ -20,10 +26,22 @@ class RenderBaseComponent : public Component<RenderBaseComponent>
 {
 public:
     explicit RenderBaseComponent(Entity*, Engine* engine);
-    ~RenderBaseComponent();
 
-    Task<> tick(time_point time, duration elapsed);
-    Task<> init();
+    // the transform, kept packed in the component pool apart from the matrices, so that the per-frame update and
+    //  anything else looking up positions only touch a few bytes per entity
+    struct HotData
+    {
+        glm::vec3 pos{0.f};
+        glm::quat rot{1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale{1.f, 1.f, 1.f};
+        // simulation tick the transform last changed on
+        uint64_t changed_tick{0};
+        bool should_update_matrix{true};
+    };
+
+    // the per-frame pass over a chunk of a runner's components: which transforms need their matrices rebuilt is
+    //  decided from the pool's packed HotData a chunk at a time, and only those components do the matrix math
+    static void updateAll(std::span<std::unique_ptr<RenderBaseComponent>> components, time_point time, duration elapsed);
 
     std::tuple<vk::Buffer, size_t, size_t> getUniformBuffer(uint32_t image) const;
 
@@ -32,9 +50,9 @@ public:
     glm::mat4 getModelMatrixIT() const { return modelIT; }
     glm::mat4 getPrevModelMatrix() const { return model_prev; }
 
-    glm::vec3 getPos() const { return pos; }
-    glm::quat getRot() const { return rot; }
-    glm::vec3 getScale() const { return scale; }
+    glm::vec3 getPos() const { return hot().pos; }
+    glm::quat getRot() const { return hot().rot; }
+    glm::vec3 getScale() const { return hot().scale; }
 
     void setPos(glm::vec3 pos);
     void setRot(glm::quat rot);
@@ -61,17 +79,23 @@ protected:
         glm::mat4 model_prev;
     };
 
-    std::unique_ptr<Buffer> uniform_buffer;
-    uint8_t* uniform_buffer_mapped{nullptr};
+    // written to the upload ring each frame
+    std::array<UploadRing::Allocation, Renderer::getFrameCount()> uniform_buffers{};
 
-    bool should_update_matrix{true};
+    // keep the transform from before this simulation tick, so frames drawn until the next one can interpolate
+    void beginChange();
 
-    glm::vec3 pos{0.f};
-    glm::quat rot{1.f, 0.f, 0.f, 0.f};
-    glm::vec3 scale{1.f, 1.f, 1.f};
+    glm::vec3 prev_pos{0.f};
+    glm::quat prev_rot{1.f, 0.f, 0.f, 0.f};
+    glm::vec3 prev_scale{1.f, 1.f, 1.f};
+    // a new component starts where it was placed, rather than interpolating in from the origin
+    bool drawn{false};
 
     uint8_t billboard{0};
 
+    void updateMatrices(HotData& transform, bool interpolating, float alpha);
+    void writeUniforms(uint32_t frame);
+
     glm::mat4 model{};
     glm::mat4 modelT{};
     glm::mat4 modelIT{};
@@ -80,70 +104,108 @@ protected:
 
 RenderBaseComponent::RenderBaseComponent(Entity* _entity, Engine* _engine) : Component(_entity, _engine) {}
 
-RenderBaseComponent::~RenderBaseComponent() { uniform_buffer->unmap(); }
-
-Task<> RenderBaseComponent::init()
+void RenderBaseComponent::updateAll(std::span<std::unique_ptr<RenderBaseComponent>> components, time_point time, duration elapsed)
 {
-    uniform_buffer = engine->renderer->gpu->memory_manager->GetBuffer(
-        engine->renderer->uniform_buffer_align_up(sizeof(UniformBufferObject)) * engine->renderer->getFrameCount(), vk::BufferUsageFlagBits::eUniformBuffer,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-    uniform_buffer_mapped = static_cast<uint8_t*>(
-        uniform_buffer->map(0, engine->renderer->uniform_buffer_align_up(sizeof(UniformBufferObject)) * engine->renderer->getFrameCount(), {}));
-    co_return;
+    auto* engine = components.front()->engine;
+    const float alpha = engine->getInterpolation();
+    const auto tick = engine->getSimulationTick();
+    const auto frame = engine->renderer->getCurrentFrame();
+    ComponentPool<RenderBaseComponent>::forEachHotChunk(components, [&](const auto& chunk)
+    {
+        for (auto mask = chunk.mask; mask != 0; mask &= mask - 1)
+        {
+            const auto slot = static_cast<uint32_t>(std::countr_zero(mask));
+            auto& transform = chunk.hot[slot];
+            // the transform only moves between the last two ticks if it was changed on the newest one
+            const bool interpolating = transform.changed_tick == tick && alpha < 1.f;
+            auto& component = chunk.component(slot);
+            if (component.removed())
+                continue;
+            component.model_prev = component.model;
+            if (transform.should_update_matrix || interpolating)
+                component.updateMatrices(transform, interpolating, alpha);
+            component.writeUniforms(frame);
+        }
+    });
 }
 
-Task<> RenderBaseComponent::tick(time_point time, duration elapsed)
+void RenderBaseComponent::updateMatrices(HotData& transform, bool interpolating, float alpha)
 {
-    model_prev = model;
-    if (should_update_matrix)
+    if (!drawn)
     {
-        if (billboard != Billboard::None)
-        {
-            auto rot_mat = glm::transpose(glm::mat4_cast(rot));
-            auto camera_mat = glm::mat4(glm::transpose(glm::mat3(engine->camera->getViewMatrix())));
-            if (billboard == Billboard::Y)
-            {
-                camera_mat[1] = glm::vec4(0, 1, 0, 0);
-                camera_mat[2].y = 0;
-            }
-            model = glm::translate(glm::mat4{1.f}, pos) * camera_mat * rot_mat * glm::scale(glm::mat4{1.f}, scale);
-        }
-        else
+        prev_pos = transform.pos;
+        prev_rot = transform.rot;
+        prev_scale = transform.scale;
+        drawn = true;
+    }
+    auto draw_pos = interpolating ? glm::mix(prev_pos, transform.pos, alpha) : transform.pos;
+    auto draw_rot = interpolating ? glm::slerp(prev_rot, transform.rot, alpha) : transform.rot;
+    auto draw_scale = interpolating ? glm::mix(prev_scale, transform.scale, alpha) : transform.scale;
+    if (billboard != Billboard::None)
+    {
+        auto rot_mat = glm::transpose(glm::mat4_cast(draw_rot));
+        auto camera_mat = glm::mat4(glm::transpose(glm::mat3(engine->camera->getViewMatrix())));
+        if (billboard == Billboard::Y)
         {
-            model = glm::translate(glm::mat4{1.f}, pos) * glm::transpose(glm::mat4_cast(rot)) * glm::scale(glm::mat4{1.f}, scale);
+            camera_mat[1] = glm::vec4(0, 1, 0, 0);
+            camera_mat[2].y = 0;
         }
-        modelT = glm::transpose(model);
-        modelIT = glm::mat3(glm::transpose(glm::inverse(model)));
-        should_update_matrix = false;
+        model = glm::translate(glm::mat4{1.f}, draw_pos) * camera_mat * rot_mat * glm::scale(glm::mat4{1.f}, draw_scale);
+    }
+    else
+    {
+        model = glm::translate(glm::mat4{1.f}, draw_pos) * glm::transpose(glm::mat4_cast(draw_rot)) * glm::scale(glm::mat4{1.f}, draw_scale);
     }
-    UniformBufferObject* ubo = reinterpret_cast<UniformBufferObject*>(
-        uniform_buffer_mapped + engine->renderer->getCurrentFrame() * engine->renderer->uniform_buffer_align_up(sizeof(UniformBufferObject)));
+    modelT = glm::transpose(model);
+    modelIT = glm::mat3(glm::transpose(glm::inverse(model)));
+    // one more update once the interpolation reaches the newest tick
+    transform.should_update_matrix = interpolating;
+}
+
+void RenderBaseComponent::writeUniforms(uint32_t frame)
+{
+    auto& uniform_buffer = uniform_buffers[frame];
+    uniform_buffer = engine->renderer->upload_ring->allocateUniform(sizeof(UniformBufferObject));
+    UniformBufferObject* ubo = uniform_buffer.as<UniformBufferObject>();
     ubo->model = model;
     ubo->modelIT = modelIT;
     ubo->model_prev = model_prev;
-    co_return;
 }
 
 std::tuple<vk::Buffer, size_t, size_t> RenderBaseComponent::getUniformBuffer(uint32_t image_index) const
 {
-    return {uniform_buffer->buffer, image_index * engine->renderer->uniform_buffer_align_up(sizeof(UniformBufferObject)), sizeof(UniformBufferObject)};
+    const auto& uniform_buffer = uniform_buffers[image_index];
+    return {uniform_buffer.buffer, uniform_buffer.offset, uniform_buffer.size};
+}
+
+void RenderBaseComponent::beginChange()
+{
+    auto& transform = hot();
+    if (auto tick = engine->getSimulationTick(); transform.changed_tick != tick)
+    {
+        prev_pos = transform.pos;
+        prev_rot = transform.rot;
+        prev_scale = transform.scale;
+        transform.changed_tick = tick;
+    }
+    transform.should_update_matrix = true;
 }
 
 void RenderBaseComponent::setPos(glm::vec3 _pos)
 {
-    pos = _pos;
-    should_update_matrix = true;
+    beginChange();
+    hot().pos = _pos;
 }
 
 void RenderBaseComponent::setRot(glm::quat _rot)
 {
-    rot = _rot;
-    should_update_matrix = true;
+    beginChange();
+    hot().rot = _rot;
 }
 
 void RenderBaseComponent::setScale(glm::vec3 _scale)
 {
-    scale = _scale;
-    should_update_matrix = true;
+    beginChange();
+    hot().scale = _scale;
 }
 } // namespace lotus::Component
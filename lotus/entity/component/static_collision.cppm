@@ -28,7 +28,7 @@ class StaticCollisionComponent : public Component<StaticCollisionComponent>
 public:
     explicit StaticCollisionComponent(Entity*, Engine* engine, std::vector<std::shared_ptr<Model>> models);
 
-    Task<> tick(time_point time, duration delta);
+    void update(time_point time, duration delta);
 
 protected:
     std::vector<std::shared_ptr<Model>> models;
@@ -39,7 +39,7 @@ StaticCollisionComponent::StaticCollisionComponent(Entity* _entity, Engine* _eng
 {
 }
 
-Task<> StaticCollisionComponent::tick(time_point time, duration delta)
+void StaticCollisionComponent::update(time_point time, duration delta)
 {
     uint32_t image = engine->renderer->getCurrentFrame();
 
@@ -62,13 +62,13 @@ Task<> StaticCollisionComponent::tick(time_point time, duration delta)
                                                                   .flags = (VkGeometryInstanceFlagsKHR)vk::GeometryInstanceFlagBitsKHR::eTriangleCullDisable,
                                                                   .accelerationStructureReference = as->handle};
                     memcpy(&instance.transform, &matrix, sizeof(matrix));
-                    // ???
-                    as->instanceid = tlas->AddInstance(instance);
+                    // the BLAS is shared by every instance of the model (and ticked concurrently), so there's no single
+                    //  instance id to keep on it
+                    tlas->AddInstance(instance);
                 }
             }
         }
     }
-    co_return;
 }
 } // namespace Component
 } // namespace lotus
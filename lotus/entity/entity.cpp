@@ -1,6 +1,11 @@
 module;
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
 module lotus;
 
@@ -9,7 +14,92 @@ import glm;
 
 namespace lotus
 {
-Entity::Entity() {}
+namespace
+{
+// generation table for EntityHandle lookups
+//  paged so that lookups can read it without a lock while entities are being created on other threads
+class EntityTable
+{
+public:
+    struct Slot
+    {
+        std::atomic<Entity*> entity{nullptr};
+        std::atomic<uint32_t> generation{0};
+    };
+
+    ~EntityTable()
+    {
+        for (auto& page : pages)
+            delete[] page.load(std::memory_order::relaxed);
+    }
+
+    Slot& add(Entity* entity, uint32_t& index)
+    {
+        std::lock_guard lk{mutex};
+        if (free_indices.empty())
+        {
+            if (next_index == page_size * max_pages)
+                throw std::runtime_error("too many entities");
+            if (next_index % page_size == 0)
+                pages[next_index / page_size].store(new Slot[page_size], std::memory_order::release);
+            index = next_index++;
+        }
+        else
+        {
+            index = free_indices.back();
+            free_indices.pop_back();
+        }
+        auto& slot = *find(index);
+        slot.entity.store(entity, std::memory_order::release);
+        return slot;
+    }
+
+    void remove(uint32_t index)
+    {
+        auto& slot = *find(index);
+        slot.generation.fetch_add(1, std::memory_order::release);
+        slot.entity.store(nullptr, std::memory_order::release);
+        std::lock_guard lk{mutex};
+        free_indices.push_back(index);
+    }
+
+    Slot* find(uint32_t index)
+    {
+        if (index >= page_size * max_pages)
+            return nullptr;
+        auto* page = pages[index / page_size].load(std::memory_order::acquire);
+        return page ? &page[index % page_size] : nullptr;
+    }
+
+private:
+    static constexpr uint32_t page_size{4096};
+    static constexpr uint32_t max_pages{1024};
+
+    std::mutex mutex;
+    std::vector<uint32_t> free_indices;
+    uint32_t next_index{0};
+    std::array<std::atomic<Slot*>, max_pages> pages{};
+};
+
+EntityTable entity_table;
+} // namespace
+
+Entity::Entity() { generation = entity_table.add(this, index).generation.load(std::memory_order::relaxed); }
+
+Entity::~Entity() { entity_table.remove(index); }
+
+Entity* Entity::get(EntityHandle handle)
+{
+    auto* slot = entity_table.find(handle.index);
+    if (!slot || slot->generation.load(std::memory_order::acquire) != handle.generation)
+        return nullptr;
+    auto* entity = slot->entity.load(std::memory_order::acquire);
+    // the slot may have been freed and reused between the two loads - if the entity loaded is a newer one, the
+    //  generation bump that freed the slot is visible by now
+    if (slot->generation.load(std::memory_order::acquire) != handle.generation)
+        return nullptr;
+    return entity;
+}
 
 void Entity::setSharedPtr(std::shared_ptr<Entity> ptr) { self_shared = ptr; }
 
@@ -1,7 +1,13 @@
 module;
 
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
 
 export module lotus:entity;
 
@@ -10,17 +16,34 @@ import :util;
 export namespace lotus
 {
 class Scene;
+
+// generational reference to an entity - trivially copyable, and resolves to nullptr once the entity is destroyed
+struct EntityHandle
+{
+    uint32_t index{std::numeric_limits<uint32_t>::max()};
+    uint32_t generation{0};
+
+    explicit operator bool() const { return index != std::numeric_limits<uint32_t>::max(); }
+    bool operator==(const EntityHandle&) const = default;
+};
+
 class Entity final
 {
 public:
     explicit Entity();
     Entity(const Entity&) = delete;
     Entity& operator=(const Entity&) = delete;
-    Entity(Entity&&) = default;
-    Entity& operator=(Entity&&) = default;
-    ~Entity() = default;
+    Entity(Entity&&) = delete;
+    Entity& operator=(Entity&&) = delete;
+    ~Entity();
 
     static uint32_t ID() { return IDGenerator<Entity, uint32_t>::template GetNewID<Entity>(); }
+    // dense index, unique among live entities (indices are reused once an entity is destroyed)
+    uint32_t getIndex() const { return index; }
+    EntityHandle getHandle() const { return {.index = index, .generation = generation}; }
+    // returns nullptr if the entity has been destroyed
+    //  the entity is only guaranteed to stay alive while its scene isn't removing entities (ie. during component ticks)
+    static Entity* get(EntityHandle handle);
 
     bool should_remove() { return removed; };
     void remove() { removed = true; }
@@ -32,5 +55,74 @@ private:
     // toggle when the entity is to be removed from the scene
     bool removed{false};
     std::weak_ptr<Entity> self_shared;
+    uint32_t index;
+    uint32_t generation;
+};
+
+// Fixed-size block storage for entities (and their shared_ptr control blocks), owned by a Scene
+class EntitySlab
+{
+public:
+    EntitySlab() = default;
+    EntitySlab(const EntitySlab&) = delete;
+    EntitySlab& operator=(const EntitySlab&) = delete;
+
+    static constexpr size_t block_size{128};
+
+    void* allocate(size_t size)
+    {
+        if (size > block_size)
+            return ::operator new(size);
+        std::lock_guard lk{mutex};
+        if (!free_blocks)
+        {
+            auto& chunk = chunks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(block_size * blocks_per_chunk));
+            for (size_t i = blocks_per_chunk; i > 0; --i)
+                free_blocks = new (chunk.get() + (i - 1) * block_size) FreeBlock{free_blocks};
+        }
+        return std::exchange(free_blocks, free_blocks->next);
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        if (size > block_size)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        std::lock_guard lk{mutex};
+        free_blocks = new (ptr) FreeBlock{free_blocks};
+    }
+
+private:
+    static constexpr size_t blocks_per_chunk{256};
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    std::mutex mutex;
+    FreeBlock* free_blocks{nullptr};
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+};
+
+// allocator for std::allocate_shared - each allocation keeps the slab alive, so entities may outlive their scene
+template <typename T> class EntitySlabAllocator
+{
+public:
+    using value_type = T;
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    explicit EntitySlabAllocator(std::shared_ptr<EntitySlab> _slab) : slab(std::move(_slab)) {}
+    template <typename U> EntitySlabAllocator(const EntitySlabAllocator<U>& other) : slab(other.slab) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(slab->allocate(n * sizeof(T))); }
+    void deallocate(T* ptr, size_t n) { slab->deallocate(ptr, n * sizeof(T)); }
+
+    template <typename U> bool operator==(const EntitySlabAllocator<U>& other) const { return slab == other.slab; }
+
+private:
+    template <typename U> friend class EntitySlabAllocator;
+    std::shared_ptr<EntitySlab> slab;
 };
 } // namespace lotus
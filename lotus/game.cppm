@@ -20,12 +20,19 @@ public:
 
     virtual Task<> entry() = 0;
     void run() { engine->run(); }
+    // one fixed simulation tick
     Task<> tick_all(time_point time, duration delta)
     {
         co_await tick(time, delta);
         if (scene)
             co_await scene->tick_all(time, delta);
     }
+    // once per rendered frame, after any simulation ticks
+    Task<> update_all(time_point time, duration delta)
+    {
+        if (scene)
+            co_await scene->update_all(time, delta);
+    }
     std::unique_ptr<Engine> engine;
     std::unique_ptr<Scene> scene;
     Task<> update_scene(std::unique_ptr<Scene>&& scene);
@@ -36,7 +43,13 @@ protected:
 
 Task<> Game::update_scene(std::unique_ptr<Scene>&& next_scene)
 {
+    // stop the outgoing scene's in-flight loads now, rather than letting them finish uploading for nothing
+    if (scene)
+        scene->cancel();
     co_await engine->worker_pool->waitForFrame();
+    // frames still being submitted (or on the GPU) can refer to the old scene's resources
+    if (scene)
+        engine->worker_pool->gpuResource(std::move(scene));
     scene = std::move(next_scene);
 }
 } // namespace lotus
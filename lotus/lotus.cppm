@@ -23,6 +23,7 @@ export import :entity.component.instanced_raytrace;
 export import :entity.component.particle;
 export import :entity.component.particle_raster;
 export import :entity.component.particle_raytrace;
+export import :entity.component.pool;
 export import :entity.component.render_base;
 export import :entity.component.static_collision;
 export import :renderer.animation;
@@ -36,6 +37,7 @@ export import :renderer.texture;
 export import :renderer.vulkan.gpu;
 export import :renderer.vulkan.renderer;
 export import :renderer.vulkan.settings;
+export import :renderer.vulkan.upload_ring;
 export import :ui;
 export import :ui.element;
 export import :util;
@@ -130,16 +130,9 @@ WorkerTask<> TopLevelAccelerationStructure::Build(Engine* engine)
 {
     uint32_t instance_count = instance_index.load();
     // priority: 2
-    vk::CommandBufferAllocateInfo alloc_info{
-        .commandPool = *renderer->graphics_pool,
-        .level = vk::CommandBufferLevel::ePrimary,
-        .commandBufferCount = 1,
-    };
-
-    auto command_buffers = renderer->gpu->device->allocateCommandBuffersUnique(alloc_info);
-    auto command_buffer = std::move(command_buffers[0]);
+    auto command_buffer = renderer->getTransientCommandBuffer();
 
-    command_buffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    command_buffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
     bool update = true;
 
@@ -176,15 +169,14 @@ WorkerTask<> TopLevelAccelerationStructure::Build(Engine* engine)
         .dstAccessMask = vk::AccessFlagBits2::eAccelerationStructureWriteKHR | vk::AccessFlagBits2::eAccelerationStructureReadKHR,
     };
 
-    command_buffer->pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+    command_buffer.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
 
-    BuildAccelerationStructure(*command_buffer, instance_data_vec, instance_range_vec,
+    BuildAccelerationStructure(command_buffer, instance_data_vec, instance_range_vec,
                                update ? vk::BuildAccelerationStructureModeKHR::eUpdate : vk::BuildAccelerationStructureModeKHR::eBuild);
 
-    command_buffer->end();
+    command_buffer.end();
 
-    engine->worker_pool->command_buffers.graphics_primary.queue(*command_buffer);
-    engine->worker_pool->gpuResource(std::move(command_buffer));
+    engine->worker_pool->command_buffers.graphics_primary.queue(command_buffer);
     co_return;
 }
 
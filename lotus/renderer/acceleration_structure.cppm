@@ -54,6 +54,8 @@ public:
                                      std::vector<vk::AccelerationStructureBuildRangeInfoKHR>&& geometry_ranges, std::vector<uint32_t>&& max_primitive_counts,
                                      bool updateable, bool compact, Performance performance);
     void Update(vk::CommandBuffer buffer);
+    // TLAS index of the structure's instance - only kept for structures with a single owner (deformed meshes), since
+    //  shared ones are instanced by many components at once
     uint32_t instanceid{0};
 
 private:
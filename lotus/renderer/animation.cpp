@@ -1,7 +1,21 @@
 module;
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstdint>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOTUS_ANIMATION_SSE
+#endif
 
 module lotus;
 
@@ -11,22 +25,123 @@ import glm;
 
 namespace lotus
 {
+namespace
+{
+// value each channel is padded with, so unused bones hold an identity transform
+constexpr std::array<float, 10> identity_channels{0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 1.f, 1.f};
+
+constexpr uint16_t value_mask{0x7fff};
+constexpr float rotation_range{std::numbers::sqrt2_v<float> / 2.f};
+
+// smallest three: whichever component is largest is dropped (and made positive, since q and -q are the same rotation)
+//  which limits the other three to +-1/sqrt(2).  they get 15 bits each, and the index of the dropped component goes
+//  in the top bits of the first two
+std::array<uint16_t, 3> quantizeRotation(glm::quat rot)
+{
+    std::array<float, 4> components{rot.x, rot.y, rot.z, rot.w};
+    const auto largest = static_cast<size_t>(std::ranges::max_element(components, {}, [](float c) { return std::abs(c); }) - components.begin());
+    const float sign = components[largest] < 0.f ? -1.f : 1.f;
+    std::array<uint16_t, 3> value{};
+    for (size_t i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        const auto normalised = std::clamp(components[i] * sign / rotation_range * 0.5f + 0.5f, 0.f, 1.f);
+        value[j++] = static_cast<uint16_t>(std::lround(normalised * value_mask));
+    }
+    value[0] |= static_cast<uint16_t>((largest & 1) << 15);
+    value[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+    return value;
+}
+
+glm::quat dequantizeRotation(std::array<uint16_t, 3> value)
+{
+    const size_t largest = (value[0] >> 15) | ((value[1] >> 15) << 1);
+    std::array<float, 4> components{};
+    float sum = 0.f;
+    for (size_t i = 0, j = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        components[i] = (static_cast<float>(value[j++] & value_mask) / value_mask - 0.5f) * 2.f * rotation_range;
+        sum += components[i] * components[i];
+    }
+    components[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+    glm::quat rot;
+    rot.x = components[0];
+    rot.y = components[1];
+    rot.z = components[2];
+    rot.w = components[3];
+    return rot;
+}
+
+std::array<uint16_t, 3> quantizeRange(glm::vec3 v, glm::vec3 min, glm::vec3 extent)
+{
+    std::array<uint16_t, 3> value{};
+    for (int i = 0; i < 3; ++i)
+    {
+        if (extent[i] > 0.f)
+            value[i] = static_cast<uint16_t>(std::lround(std::clamp((v[i] - min[i]) / extent[i], 0.f, 1.f) * std::numeric_limits<uint16_t>::max()));
+    }
+    return value;
+}
+
+glm::vec3 dequantizeRange(std::array<uint16_t, 3> value, glm::vec3 min, glm::vec3 extent)
+{
+    return min + glm::vec3(value[0], value[1], value[2]) / static_cast<float>(std::numeric_limits<uint16_t>::max()) * extent;
+}
+
+// the same shortest path nlerp as the sampling kernel, so that key removal measures what will actually be played
+glm::quat nlerp(glm::quat a, glm::quat b, float t)
+{
+    if (glm::dot(a, b) < 0.f)
+        b = -b;
+    return glm::normalize(a + (b - a) * t);
+}
+
+float rotationError(glm::quat a, glm::quat b) { return 2.f * std::acos(std::min(1.f, std::abs(glm::dot(a, b)))); }
+
+// greedily extend each span between kept keys for as long as interpolating across it stays within tolerance of the
+//  source frames.  the first and last frames are always kept
+template <typename T, typename Lerp, typename Error>
+std::vector<size_t> reduceKeys(std::span<const T> source, std::span<const T> quantised, float tolerance, Lerp lerp, Error error)
+{
+    std::vector<size_t> keys{0};
+    size_t anchor = 0;
+    for (size_t end = 2; end < source.size(); ++end)
+    {
+        for (size_t frame = anchor + 1; frame < end; ++frame)
+        {
+            const float t = static_cast<float>(frame - anchor) / static_cast<float>(end - anchor);
+            if (error(lerp(quantised[anchor], quantised[end], t), source[frame]) > tolerance)
+            {
+                anchor = end - 1;
+                keys.push_back(anchor);
+                break;
+            }
+        }
+    }
+    if (source.size() > 1)
+        keys.push_back(source.size() - 1);
+    return keys;
+}
+} // namespace
+
 Animation::Animation(std::string _name, duration _frame_duration) : name(_name), frame_duration(_frame_duration) {}
 
 void Animation::addFrameData(uint32_t frame, uint32_t bone_index, uint32_t parent_bone_index, glm::quat rot, glm::vec3 trans, BoneTransform transform)
 {
+    if (compressed())
+        throw std::logic_error("frame data added to animation " + name + " after it was compressed");
     // multiply with skeleton
-    if (frame >= transforms.size())
-    {
-        transforms.resize(frame + 1);
-    }
+    reserve(frame, bone_index);
 
     BoneTransform new_transform;
 
     if (bone_index != 0)
     {
         BoneTransform local_transform = {transform.rot * rot, trans + transform.trans, transform.scale};
-        const BoneTransform& parent_transform = transforms[frame][parent_bone_index];
+        const BoneTransform parent_transform = keyframe(frame, parent_bone_index);
         new_transform = {parent_transform.rot * local_transform.rot, parent_transform.trans + (parent_transform.rot * local_transform.trans),
                          local_transform.scale * parent_transform.scale};
     }
@@ -35,6 +150,328 @@ void Animation::addFrameData(uint32_t frame, uint32_t bone_index, uint32_t paren
         new_transform = {transform.rot * rot, trans + transform.trans, transform.scale};
     }
 
-    transforms[frame][bone_index] = new_transform;
+    setKeyframe(frame, bone_index, new_transform);
+}
+
+void Animation::reserve(size_t frame, size_t bone)
+{
+    if (bone >= bone_stride)
+    {
+        // only while loading, and only as often as the bone count crosses a multiple of the lane count
+        const auto new_stride = (bone / bone_lanes + 1) * bone_lanes;
+        for (size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            std::vector<float> widened(frame_count * new_stride, identity_channels[channel]);
+            for (size_t f = 0; f < frame_count; ++f)
+            {
+                std::ranges::copy_n(channels[channel].begin() + f * bone_stride, bone_stride, widened.begin() + f * new_stride);
+            }
+            channels[channel] = std::move(widened);
+        }
+        bone_stride = new_stride;
+    }
+    if (frame >= frame_count)
+    {
+        frame_count = frame + 1;
+        for (size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            channels[channel].resize(frame_count * bone_stride, identity_channels[channel]);
+        }
+    }
+    bone_count = std::max(bone_count, bone + 1);
+}
+
+void Animation::setKeyframe(size_t frame, size_t bone, const BoneTransform& transform)
+{
+    const auto i = index(frame, bone);
+    channels[RotX][i] = transform.rot.x;
+    channels[RotY][i] = transform.rot.y;
+    channels[RotZ][i] = transform.rot.z;
+    channels[RotW][i] = transform.rot.w;
+    channels[TransX][i] = transform.trans.x;
+    channels[TransY][i] = transform.trans.y;
+    channels[TransZ][i] = transform.trans.z;
+    channels[ScaleX][i] = transform.scale.x;
+    channels[ScaleY][i] = transform.scale.y;
+    channels[ScaleZ][i] = transform.scale.z;
+}
+
+Animation::BoneTransform Animation::keyframe(size_t frame, size_t bone) const
+{
+    BoneTransform transform{.rot = glm::quat{1.f, 0.f, 0.f, 0.f}, .trans = glm::vec3{0.f}, .scale = glm::vec3{1.f}};
+    if (frame >= frame_count || bone >= bone_count)
+        return transform;
+    if (compressed())
+        return decode(frame, bone);
+    const auto i = index(frame, bone);
+    transform.rot.x = channels[RotX][i];
+    transform.rot.y = channels[RotY][i];
+    transform.rot.z = channels[RotZ][i];
+    transform.rot.w = channels[RotW][i];
+    transform.trans = {channels[TransX][i], channels[TransY][i], channels[TransZ][i]};
+    transform.scale = {channels[ScaleX][i], channels[ScaleY][i], channels[ScaleZ][i]};
+    return transform;
+}
+
+void Animation::sample(size_t frame, size_t next_frame, float t, std::span<BoneTransform> out) const
+{
+    const auto count = std::min(out.size(), bone_count);
+    ChannelPointers a;
+    ChannelPointers b;
+    if (compressed())
+    {
+        // decode both keyframes into the same layout as the uncompressed tracks, so they share the kernel
+        thread_local std::vector<float> decoded;
+        // the layout the buffer's padding was last filled for
+        thread_local size_t decoded_stride{0};
+        thread_local size_t decoded_count{0};
+        decoded.resize(bone_stride * ChannelCount * 2);
+        for (size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            a[channel] = decoded.data() + bone_stride * channel;
+            b[channel] = decoded.data() + bone_stride * (ChannelCount + channel);
+        }
+        auto store = [this](float* base, const BoneTransform& transform)
+        {
+            const std::array<float, ChannelCount> values{transform.rot.x,   transform.rot.y,   transform.rot.z,   transform.rot.w,   transform.trans.x,
+                                                         transform.trans.y, transform.trans.z, transform.scale.x, transform.scale.y, transform.scale.z};
+            for (size_t channel = 0; channel < ChannelCount; ++channel)
+                base[bone_stride * channel] = values[channel];
+        };
+        // only the bones being sampled are decoded.  the kernel reads whole lane groups, so the rest of the stride
+        //  is identity, the same as the uncompressed tracks - only written when the layout changes, since nothing
+        //  else writes past count
+        const BoneTransform identity{.rot = glm::quat{1.f, 0.f, 0.f, 0.f}, .trans = glm::vec3{0.f}, .scale = glm::vec3{1.f}};
+        if (decoded_stride != bone_stride || decoded_count != count)
+        {
+            for (size_t bone = count; bone < bone_stride; ++bone)
+            {
+                store(decoded.data() + bone, identity);
+                store(decoded.data() + bone_stride * ChannelCount + bone, identity);
+            }
+            decoded_stride = bone_stride;
+            decoded_count = count;
+        }
+        for (size_t bone = 0; bone < count; ++bone)
+        {
+            store(decoded.data() + bone, frame < frame_count ? decode(frame, bone) : identity);
+            store(decoded.data() + bone_stride * ChannelCount + bone, next_frame < frame_count ? decode(next_frame, bone) : identity);
+        }
+    }
+    else
+    {
+        for (size_t channel = 0; channel < ChannelCount; ++channel)
+        {
+            a[channel] = channels[channel].data() + index(frame, 0);
+            b[channel] = channels[channel].data() + index(next_frame, 0);
+        }
+    }
+    interpolate(a, b, count, t, out);
+    std::ranges::fill(out.subspan(count), BoneTransform{.rot = glm::quat{1.f, 0.f, 0.f, 0.f}, .trans = glm::vec3{0.f}, .scale = glm::vec3{1.f}});
+}
+
+// rotations are nlerped rather than slerped - keyframes are close enough together that the difference is
+//  negligible, and it needs nothing more than a multiply-add and a normalise
+void Animation::interpolate(const ChannelPointers& a, const ChannelPointers& b, size_t count, float t, std::span<BoneTransform> out)
+{
+    size_t bone = 0;
+#ifdef LOTUS_ANIMATION_SSE
+    constexpr size_t lanes = 4;
+    const __m128 t4 = _mm_set1_ps(t);
+    const __m128 sign_mask = _mm_set1_ps(-0.f);
+    // bone_stride is a multiple of the lane count, so the last group can read past count without leaving the frame
+    for (; bone < count; bone += lanes)
+    {
+        __m128 result[ChannelCount];
+        // take the shortest path between the two rotations
+        __m128 dot = _mm_setzero_ps();
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+            dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(a[channel] + bone), _mm_loadu_ps(b[channel] + bone)));
+        const __m128 flip = _mm_and_ps(dot, sign_mask);
+        __m128 length = _mm_setzero_ps();
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+        {
+            const __m128 from = _mm_loadu_ps(a[channel] + bone);
+            const __m128 to = _mm_xor_ps(_mm_loadu_ps(b[channel] + bone), flip);
+            result[channel] = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), t4));
+            length = _mm_add_ps(length, _mm_mul_ps(result[channel], result[channel]));
+        }
+        length = _mm_sqrt_ps(length);
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+            result[channel] = _mm_div_ps(result[channel], length);
+        for (size_t channel = TransX; channel < ChannelCount; ++channel)
+        {
+            const __m128 from = _mm_loadu_ps(a[channel] + bone);
+            const __m128 to = _mm_loadu_ps(b[channel] + bone);
+            result[channel] = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), t4));
+        }
+
+        alignas(16) std::array<std::array<float, lanes>, ChannelCount> lane_values;
+        for (size_t channel = 0; channel < ChannelCount; ++channel)
+            _mm_store_ps(lane_values[channel].data(), result[channel]);
+        for (size_t lane = 0; lane < lanes && bone + lane < count; ++lane)
+        {
+            auto& transform = out[bone + lane];
+            transform.rot.x = lane_values[RotX][lane];
+            transform.rot.y = lane_values[RotY][lane];
+            transform.rot.z = lane_values[RotZ][lane];
+            transform.rot.w = lane_values[RotW][lane];
+            transform.trans = {lane_values[TransX][lane], lane_values[TransY][lane], lane_values[TransZ][lane]};
+            transform.scale = {lane_values[ScaleX][lane], lane_values[ScaleY][lane], lane_values[ScaleZ][lane]};
+        }
+    }
+#endif
+    for (; bone < count; ++bone)
+    {
+        std::array<float, ChannelCount> result;
+        float dot = 0.f;
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+            dot += a[channel][bone] * b[channel][bone];
+        const float flip = dot < 0.f ? -1.f : 1.f;
+        float length = 0.f;
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+        {
+            result[channel] = a[channel][bone] + (b[channel][bone] * flip - a[channel][bone]) * t;
+            length += result[channel] * result[channel];
+        }
+        length = std::sqrt(length);
+        for (size_t channel = RotX; channel <= RotW; ++channel)
+            result[channel] /= length;
+        for (size_t channel = TransX; channel < ChannelCount; ++channel)
+            result[channel] = a[channel][bone] + (b[channel][bone] - a[channel][bone]) * t;
+
+        auto& transform = out[bone];
+        transform.rot.x = result[RotX];
+        transform.rot.y = result[RotY];
+        transform.rot.z = result[RotZ];
+        transform.rot.w = result[RotW];
+        transform.trans = {result[TransX], result[TransY], result[TransZ]};
+        transform.scale = {result[ScaleX], result[ScaleY], result[ScaleZ]};
+    }
+}
+
+void Animation::compress(const AnimationCompressionSettings& settings)
+{
+    if (compressed() || frame_count == 0)
+        return;
+    if (frame_count > std::numeric_limits<uint16_t>::max() + size_t{1})
+        throw std::length_error("animation " + name + " has too many frames to compress");
+
+    std::vector<Track> new_tracks;
+    std::vector<uint16_t> new_key_frames;
+    std::vector<KeyValue> new_key_values;
+    new_tracks.reserve(bone_count * TrackTypeCount);
+
+    std::vector<glm::quat> rotations(frame_count);
+    std::vector<glm::quat> quantised_rotations(frame_count);
+    std::vector<glm::vec3> vectors(frame_count);
+    std::vector<glm::vec3> quantised_vectors(frame_count);
+    std::vector<KeyValue> values(frame_count);
+
+    auto add_track = [&](const std::vector<size_t>& keys, glm::vec3 range_min, glm::vec3 range_extent)
+    {
+        new_tracks.push_back({.first_key = static_cast<uint32_t>(new_key_frames.size()),
+                              .key_count = static_cast<uint32_t>(keys.size()),
+                              .range_min = range_min,
+                              .range_extent = range_extent});
+        for (auto key : keys)
+        {
+            new_key_frames.push_back(static_cast<uint16_t>(key));
+            new_key_values.push_back(values[key]);
+        }
+    };
+
+    for (size_t bone = 0; bone < bone_count; ++bone)
+    {
+        for (size_t frame = 0; frame < frame_count; ++frame)
+        {
+            rotations[frame] = keyframe(frame, bone).rot;
+            values[frame] = quantizeRotation(rotations[frame]);
+            quantised_rotations[frame] = dequantizeRotation(values[frame]);
+        }
+        add_track(reduceKeys<glm::quat>(rotations, quantised_rotations, settings.rotation_tolerance, nlerp, rotationError), {}, {});
+
+        for (auto type : {TranslationTrack, ScaleTrack})
+        {
+            for (size_t frame = 0; frame < frame_count; ++frame)
+            {
+                const auto transform = keyframe(frame, bone);
+                vectors[frame] = type == TranslationTrack ? transform.trans : transform.scale;
+            }
+            auto range_min = vectors[0];
+            auto range_max = vectors[0];
+            for (const auto& v : vectors)
+            {
+                range_min = glm::min(range_min, v);
+                range_max = glm::max(range_max, v);
+            }
+            const auto range_extent = range_max - range_min;
+            for (size_t frame = 0; frame < frame_count; ++frame)
+            {
+                values[frame] = quantizeRange(vectors[frame], range_min, range_extent);
+                quantised_vectors[frame] = dequantizeRange(values[frame], range_min, range_extent);
+            }
+            const float tolerance = type == TranslationTrack ? settings.translation_tolerance : settings.scale_tolerance;
+            add_track(reduceKeys<glm::vec3>(vectors, quantised_vectors, tolerance, [](glm::vec3 a, glm::vec3 b, float t) { return glm::mix(a, b, t); },
+                                            [](glm::vec3 a, glm::vec3 b) { return glm::length(a - b); }),
+                      range_min, range_extent);
+        }
+    }
+
+    tracks = std::move(new_tracks);
+    key_frames = std::move(new_key_frames);
+    key_values = std::move(new_key_values);
+    for (auto& channel : channels)
+    {
+        channel.clear();
+        channel.shrink_to_fit();
+    }
+}
+
+Animation::MemoryReport Animation::memoryReport() const
+{
+    MemoryReport report{.uncompressed_bytes = frame_count * bone_stride * ChannelCount * sizeof(float), .source_keys = frame_count * bone_count * TrackTypeCount};
+    if (compressed())
+    {
+        report.bytes = tracks.capacity() * sizeof(Track) + key_frames.capacity() * sizeof(uint16_t) + key_values.capacity() * sizeof(KeyValue);
+        report.keys = key_frames.size();
+    }
+    else
+    {
+        for (const auto& channel : channels)
+            report.bytes += channel.capacity() * sizeof(float);
+        report.keys = report.source_keys;
+    }
+    return report;
+}
+
+Animation::BoneTransform Animation::decode(size_t frame, size_t bone) const
+{
+    const auto* bone_tracks = tracks.data() + bone * TrackTypeCount;
+    return {.rot = decodeTrack<glm::quat>(bone_tracks[RotationTrack], frame),
+            .trans = decodeTrack<glm::vec3>(bone_tracks[TranslationTrack], frame),
+            .scale = decodeTrack<glm::vec3>(bone_tracks[ScaleTrack], frame)};
+}
+
+template <typename T> T Animation::decodeTrack(const Track& track, size_t frame) const
+{
+    auto dequantize = [&](uint32_t key)
+    {
+        if constexpr (std::is_same_v<T, glm::quat>)
+            return dequantizeRotation(key_values[key]);
+        else
+            return dequantizeRange(key_values[key], track.range_min, track.range_extent);
+    };
+    const std::span<const uint16_t> frames{key_frames.data() + track.first_key, track.key_count};
+    // the first key is always frame 0, so there's always a key at or before the frame
+    const auto next = static_cast<uint32_t>(std::ranges::upper_bound(frames, frame) - frames.begin());
+    if (next == frames.size())
+        return dequantize(track.first_key + next - 1);
+    const auto previous = next - 1;
+    const float t = static_cast<float>(frame - frames[previous]) / static_cast<float>(frames[next] - frames[previous]);
+    if constexpr (std::is_same_v<T, glm::quat>)
+        return nlerp(dequantize(track.first_key + previous), dequantize(track.first_key + next), t);
+    else
+        return glm::mix(dequantize(track.first_key + previous), dequantize(track.first_key + next), t);
 }
 } // namespace lotus
@@ -1,7 +1,8 @@
 module;
 
+#include <array>
 #include <cstdint>
-#include <map>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,14 @@ import glm;
 
 export namespace lotus
 {
+struct AnimationCompressionSettings
+{
+    // largest error key removal may introduce - radians for rotations, model units for translation and scale
+    float rotation_tolerance{0.001f};
+    float translation_tolerance{0.001f};
+    float scale_tolerance{0.001f};
+};
+
 class Animation
 {
 public:
@@ -26,8 +35,89 @@ public:
     std::string name;
     duration frame_duration;
 
+    struct MemoryReport
+    {
+        // what the keyframes take up as loaded, and what they take up now
+        size_t uncompressed_bytes{0};
+        size_t bytes{0};
+        // one per bone per frame for each of rotation, translation and scale, and how many of them were kept
+        size_t source_keys{0};
+        size_t keys{0};
+    };
+
+    // only valid before compress()
     void addFrameData(uint32_t frame, uint32_t bone_index, uint32_t parent_bone_index, glm::quat rot, glm::vec3 trans, BoneTransform transform);
+    // quantise the keyframes, and drop any that can be interpolated from their neighbours within the tolerance
+    //  meant to be called by the loader once all of the frame data has been added
+    void compress(const AnimationCompressionSettings& settings = {});
+    bool compressed() const { return !tracks.empty(); }
+    MemoryReport memoryReport() const;
+
+    size_t frameCount() const { return frame_count; }
+    size_t boneCount() const { return bone_count; }
+    BoneTransform keyframe(size_t frame, size_t bone) const;
+    // interpolate every bone between two keyframes into out (bones the animation doesn't have are left at identity)
+    void sample(size_t frame, size_t next_frame, float t, std::span<BoneTransform> out) const;
+
+private:
+    // tracks are kept per component rather than per transform, so sampling can load the same component of
+    //  several bones at once
+    enum Channel
+    {
+        RotX,
+        RotY,
+        RotZ,
+        RotW,
+        TransX,
+        TransY,
+        TransZ,
+        ScaleX,
+        ScaleY,
+        ScaleZ,
+        ChannelCount
+    };
+    // bones are padded to a whole number of SIMD lanes per frame
+    static constexpr size_t bone_lanes{8};
+
+    using ChannelPointers = std::array<const float*, ChannelCount>;
+
+    size_t index(size_t frame, size_t bone) const { return frame * bone_stride + bone; }
+    void reserve(size_t frame, size_t bone);
+    void setKeyframe(size_t frame, size_t bone, const BoneTransform& transform);
+    static void interpolate(const ChannelPointers& a, const ChannelPointers& b, size_t count, float t, std::span<BoneTransform> out);
+
+    size_t frame_count{0};
+    size_t bone_count{0};
+    size_t bone_stride{0};
+    // each indexed [frame * bone_stride + bone], emptied by compress()
+    std::array<std::vector<float>, ChannelCount> channels;
+
+    // compressed keyframes
+    //  every bone has a rotation, translation and scale track, each with its own keys.  a key is its frame and three
+    //  16 bit values: the smallest three components of the rotation (the largest is rebuilt from them being a unit
+    //  quaternion), or the translation/scale as a fraction of the range the track covers
+    enum TrackType
+    {
+        RotationTrack,
+        TranslationTrack,
+        ScaleTrack,
+        TrackTypeCount
+    };
+    struct Track
+    {
+        uint32_t first_key;
+        uint32_t key_count;
+        glm::vec3 range_min;
+        glm::vec3 range_extent;
+    };
+    using KeyValue = std::array<uint16_t, 3>;
+
+    BoneTransform decode(size_t frame, size_t bone) const;
+    template <typename T> T decodeTrack(const Track& track, size_t frame) const;
 
-    std::vector<std::map<uint32_t, BoneTransform>> transforms;
+    // indexed [bone * TrackTypeCount + type]
+    std::vector<Track> tracks;
+    std::vector<uint16_t> key_frames;
+    std::vector<KeyValue> key_values;
 };
 } // namespace lotus
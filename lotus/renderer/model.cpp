@@ -62,6 +62,11 @@ WorkerTask<> Model::InitWork(Engine* engine, const std::vector<std::span<const s
                                  vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
             transform_usage_flags |= vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
         }
+        else if (weighted)
+        {
+            // skinning reads the weights by address
+            vertex_usage_flags |= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+        }
         vertex_buffer = engine->renderer->gpu->memory_manager->GetBuffer(vertex_buffer_size, vertex_usage_flags, vk::MemoryPropertyFlagBits::eDeviceLocal);
         index_buffer = engine->renderer->gpu->memory_manager->GetBuffer(index_buffer_size, index_usage_flags, vk::MemoryPropertyFlagBits::eDeviceLocal);
         transform_buffer =
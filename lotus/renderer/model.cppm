@@ -1,8 +1,12 @@
 module;
 
+#include <coroutine>
+#include <exception>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -23,51 +27,65 @@ class Model
 {
 public:
     // TODO: when to clean up dead weak_ptrs?
+    //  a cache hit on a model that is still loading gets a task that waits for that load, and fails with it
     template <typename Loader, typename... Args>
     [[nodiscard("Work must be awaited before being used")]]
     static std::pair<std::shared_ptr<Model>, std::optional<Task<>>> LoadModel(std::string modelname, Loader loader, Args&&... args)
     {
-        if (!modelname.empty())
+        if (modelname.empty())
         {
+            auto new_model = std::shared_ptr<Model>(new Model(modelname));
+            return {new_model, loader(new_model, std::forward<Args>(args)...)};
+        }
+
+        std::shared_ptr<Model> new_model;
+        auto load = std::make_shared<PendingLoad>();
+        {
+            std::lock_guard lk{model_map_mutex};
             if (auto found = model_map.find(modelname); found != model_map.end())
             {
-                auto ptr = found->second.lock();
-                if (ptr)
+                if (auto ptr = found->second.model.lock())
+                {
+                    if (found->second.load)
+                        return {ptr, waitForLoad(found->second.load)};
                     return {ptr, std::optional<Task<>>{}};
-                else
-                    model_map.erase(found);
+                }
+                model_map.erase(found);
             }
+            // registered before the loader runs, so a concurrent LoadModel of the same name waits for this load
+            //  instead of starting its own
+            new_model = std::shared_ptr<Model>(new Model(modelname));
+            model_map.emplace(modelname, CacheEntry{.model = new_model, .load = load});
         }
-        auto new_model = std::shared_ptr<Model>(new Model(modelname));
         auto task = loader(new_model, std::forward<Args>(args)...);
-        if (!modelname.empty())
-        {
-            return {model_map.emplace(modelname, new_model).first->second.lock(), std::move(task)};
-        }
-        else
-        {
-            return {new_model, std::move(task)};
-        }
+        return {new_model, finishLoad(std::move(modelname), std::move(load), std::move(task))};
     }
 
     static std::shared_ptr<Model> getModel(const std::string& modelname)
     {
+        std::lock_guard lk{model_map_mutex};
         if (auto found = model_map.find(modelname); found != model_map.end())
         {
-            return found->second.lock();
+            return found->second.model.lock();
         }
         return {};
     }
 
     template <typename T> static void forEachModel(T func)
     {
-        for (const auto& [name, model] : model_map)
+        std::vector<std::shared_ptr<Model>> models;
         {
-            if (auto ptr = model.lock())
+            std::lock_guard lk{model_map_mutex};
+            for (const auto& [name, entry] : model_map)
             {
-                func(ptr);
+                if (auto ptr = entry.model.lock())
+                    models.push_back(std::move(ptr));
             }
         }
+        for (const auto& ptr : models)
+        {
+            func(ptr);
+        }
     }
 
     struct TransformEntry
@@ -102,6 +120,95 @@ public:
 protected:
     explicit Model(const std::string& name);
 
-    inline static std::unordered_map<std::string, std::weak_ptr<Model>> model_map{};
+    // a named load that hasn't finished yet - callers that hit the cache in the meantime wait on it
+    struct PendingLoad
+    {
+        std::mutex mutex;
+        bool done{false};
+        std::exception_ptr exception;
+        std::vector<std::coroutine_handle<>> waiters;
+    };
+
+    struct CacheEntry
+    {
+        std::weak_ptr<Model> model;
+        // null once the load has succeeded
+        std::shared_ptr<PendingLoad> load;
+    };
+
+    inline static std::mutex model_map_mutex;
+    inline static std::unordered_map<std::string, CacheEntry> model_map{};
+
+    class LoadAwaiter
+    {
+    public:
+        LoadAwaiter(PendingLoad* _load) : load(_load) {}
+
+        bool await_ready() noexcept
+        {
+            std::lock_guard lk{load->mutex};
+            return load->done;
+        }
+        bool await_suspend(std::coroutine_handle<> awaiter)
+        {
+            std::lock_guard lk{load->mutex};
+            if (load->done)
+                return false;
+            load->waiters.push_back(awaiter);
+            return true;
+        }
+        void await_resume()
+        {
+            cancellation.resume();
+            if (load->exception)
+                std::rethrow_exception(load->exception);
+        }
+
+    private:
+        PendingLoad* load;
+        CancellationScope::Suspended cancellation;
+    };
+
+    static Task<> waitForLoad(std::shared_ptr<PendingLoad> load) { co_await LoadAwaiter{load.get()}; }
+
+    // a failed (or cancelled) load leaves the model half-initialized, so stop handing it out, and fail everyone
+    //  who was waiting on it
+    template <Awaitable T> static Task<> finishLoad(std::string modelname, std::shared_ptr<PendingLoad> load, T task)
+    {
+        std::exception_ptr exception;
+        try
+        {
+            co_await std::move(task);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        {
+            std::lock_guard lk{model_map_mutex};
+            if (auto found = model_map.find(modelname); found != model_map.end() && found->second.load == load)
+            {
+                if (exception)
+                    model_map.erase(found);
+                else
+                    found->second.load.reset();
+            }
+        }
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard lk{load->mutex};
+            load->exception = exception;
+            load->done = true;
+            waiters = std::move(load->waiters);
+        }
+        for (auto waiter : waiters)
+        {
+            CancellationScope scope{CancellationScope::token()};
+            waiter.resume();
+        }
+        if (exception)
+            std::rethrow_exception(exception);
+    }
 };
 } // namespace lotus
@@ -4,6 +4,7 @@ module;
 #include <coroutine>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
 #include <vector>
 
 module lotus;
@@ -13,6 +14,7 @@ import :renderer.raytrace_query;
 import :core.engine;
 import :core.game;
 import :renderer.vulkan.renderer;
+import :renderer.vulkan.upload_ring;
 import glm;
 import vulkan_hpp;
 
@@ -187,6 +189,8 @@ RaytraceQueryer::RaytraceQueryer(Engine* _engine) : engine(_engine)
 
 Task<float> RaytraceQueryer::query(ObjectFlags object_flags, glm::vec3 origin, glm::vec3 direction, float min, float max)
 {
+    // the queries trace against the previous frame's TLAS, so its build has to be on the queue first
+    co_await engine->renderer->waitForSubmission();
     auto q = query_queue(object_flags, origin, direction, min, max);
     if (task_count.fetch_add(1) == 0)
     {
@@ -214,13 +218,10 @@ void RaytraceQueryer::runQueries()
 
                 size_t input_buffer_size = sizeof(RaytraceInput) * processing_queries.size();
                 size_t output_buffer_size = sizeof(RaytraceOutput) * processing_queries.size();
-                input_buffer =
-                    engine->renderer->gpu->memory_manager->GetBuffer(input_buffer_size, vk::BufferUsageFlagBits::eUniformBuffer,
-                                                                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-                output_buffer =
-                    engine->renderer->gpu->memory_manager->GetBuffer(output_buffer_size, vk::BufferUsageFlagBits::eStorageBuffer,
-                                                                     vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-                RaytraceInput* input_mapped = static_cast<RaytraceInput*>(input_buffer->map(0, input_buffer_size, {}));
+                // the batch is waited on below, long before the ring comes back around to these
+                auto input_buffer = engine->renderer->upload_ring->allocateUniform(input_buffer_size);
+                auto output_buffer = engine->renderer->upload_ring->allocateStorage(output_buffer_size);
+                RaytraceInput* input_mapped = input_buffer.as<RaytraceInput>();
                 for (size_t i = 0; i < processing_queries.size(); ++i)
                 {
                     const auto& query = processing_queries[i];
@@ -230,7 +231,6 @@ void RaytraceQueryer::runQueries()
                     input_mapped[i].max = query->data.max;
                     input_mapped[i].flags = static_cast<uint32_t>(query->data.object_flags);
                 }
-                input_buffer->unmap();
 
                 vk::CommandBufferAllocateInfo alloc_info = {};
                 alloc_info.commandPool = *command_pool;
@@ -257,10 +257,7 @@ void RaytraceQueryer::runQueries()
                 write_as.pAccelerationStructures = &*tlas->acceleration_structure;
                 write_info_as.pNext = &write_as;
 
-                vk::DescriptorBufferInfo input_buffer_info;
-                input_buffer_info.buffer = input_buffer->buffer;
-                input_buffer_info.offset = 0;
-                input_buffer_info.range = sizeof(RaytraceInput) * processing_queries.size();
+                vk::DescriptorBufferInfo input_buffer_info = input_buffer.descriptor();
 
                 vk::WriteDescriptorSet write_info_input;
                 write_info_input.descriptorCount = 1;
@@ -270,10 +267,7 @@ void RaytraceQueryer::runQueries()
                 write_info_input.pBufferInfo = &input_buffer_info;
                 write_info_input.dstSet = *rtx_descriptor_set;
 
-                vk::DescriptorBufferInfo output_buffer_info;
-                output_buffer_info.buffer = output_buffer->buffer;
-                output_buffer_info.offset = 0;
-                output_buffer_info.range = sizeof(RaytraceOutput) * processing_queries.size();
+                vk::DescriptorBufferInfo output_buffer_info = output_buffer.descriptor();
 
                 vk::WriteDescriptorSet write_info_output;
                 write_info_output.descriptorCount = 1;
@@ -299,18 +293,21 @@ void RaytraceQueryer::runQueries()
                 vk::SubmitInfo submit_info = {};
                 submit_info.pCommandBuffers = &*buffer[0];
                 submit_info.commandBufferCount = 1;
-                raytrace_query_queue.submit(submit_info, *fence);
+                {
+                    std::lock_guard lk{engine->renderer->gpu->queue_mutex};
+                    raytrace_query_queue.submit(submit_info, *fence);
+                }
                 engine->renderer->gpu->device->waitForFences(*fence, true, std::numeric_limits<uint64_t>::max());
                 engine->renderer->gpu->device->resetFences(*fence);
 
-                RaytraceOutput* output_mapped = static_cast<RaytraceOutput*>(output_buffer->map(0, output_buffer_size, {}));
+                RaytraceOutput* output_mapped = output_buffer.as<RaytraceOutput>();
                 for (size_t i = 0; i < processing_queries.size(); ++i)
                 {
                     const auto& query = processing_queries[i];
                     query->data.result = output_mapped[i].intersection_dist;
+                    CancellationScope scope{CancellationScope::token()};
                     query->awaiting.resume();
                 }
-                output_buffer->unmap();
 
                 local_task_count = task_count.fetch_sub(processing_queries.size()) - processing_queries.size();
             }
@@ -324,6 +321,7 @@ void RaytraceQueryer::runQueries()
         for (auto& query : queries)
         {
             query->data.result = query->data.max;
+            CancellationScope scope{CancellationScope::token()};
             query->awaiting.resume();
         }
         local_task_count = task_count.fetch_sub(queries.size()) - queries.size();
@@ -84,8 +84,6 @@ private:
     vk::StridedDeviceAddressRegionKHR hitSBT;
     vk::UniqueHandle<vk::Fence, vk::DispatchLoaderDynamic> fence;
     vk::UniqueHandle<vk::CommandPool, vk::DispatchLoaderDynamic> command_pool;
-    std::unique_ptr<Buffer> input_buffer;
-    std::unique_ptr<Buffer> output_buffer;
     //
 };
 } // namespace lotus
@@ -81,6 +81,6 @@ private:
     void free_index(uint32_t index, uint32_t count) { free_indices[count].queue(index); }
 
     std::atomic<uint32_t> max_index{0};
-    std::vector<SharedLinkedList<uint32_t>> free_indices;
+    std::vector<LockedQueue<uint32_t>> free_indices;
 };
 } // namespace lotus
@@ -5,6 +5,7 @@ module;
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <ranges>
 #include <vector>
 
@@ -26,6 +27,9 @@ AsyncCompute::AsyncCompute(Engine* _engine, Renderer* _renderer) : engine(_engin
 
 Task<> AsyncCompute::compute(vk::UniqueCommandBuffer buffer)
 {
+    // don't submit work for a cancelled task - throwing here frees the command buffer (and lets the caller release
+    //  whatever it was going to read from) straight away
+    CancellationScope::throwIfCancelled();
     auto t = queue_compute(std::move(buffer));
     if (task_count.fetch_add(1) == 0)
     {
@@ -33,9 +37,13 @@ Task<> AsyncCompute::compute(vk::UniqueCommandBuffer buffer)
     }
 
     co_await t;
+    CancellationScope::throwIfCancelled();
 }
 
-Task<> AsyncCompute::queue_compute(vk::UniqueCommandBuffer buffer) { engine->worker_pool->gpuResource(co_await tasks.wait({.buffer = std::move(buffer)})); }
+Task<> AsyncCompute::queue_compute(vk::UniqueCommandBuffer buffer)
+{
+    engine->worker_pool->gpuResource(co_await tasks.wait({.buffer = std::move(buffer), .stop_token = CancellationScope::token()}));
+}
 
 void AsyncCompute::checkTasks()
 {
@@ -48,20 +56,25 @@ void AsyncCompute::checkTasks()
             std::vector<vk::CommandBufferSubmitInfoKHR> submits;
             submits.resize(pending_tasks.size());
             std::ranges::transform(pending_tasks, submits.begin(), [](auto& i) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = *i->data.buffer}; });
+            std::unique_lock queue_lock{renderer->gpu->queue_mutex};
             renderer->gpu->async_compute_queue.submit2({vk::SubmitInfo2{
                                                               .commandBufferInfoCount = static_cast<uint32_t>(submits.size()),
                                                               .pCommandBufferInfos = submits.data(),
                                                           }},
                                                           *fence);
+            queue_lock.unlock();
             renderer->gpu->device->waitForFences(*fence, true, std::numeric_limits<uint64_t>::max());
             renderer->gpu->device->resetFences(*fence);
 
             for (auto& t : pending_tasks | std::ranges::views::take(pending_tasks.size() - 1))
             {
-                t->data.scheduled_task = std::make_unique<WorkerPool::ScheduledTask>(engine->worker_pool.get(), t->awaiting);
+                t->data.scheduled_task = std::make_unique<WorkerPool::ScheduledTask>(engine->worker_pool.get(), t->awaiting, t->data.stop_token);
                 t->data.scheduled_task->queueTask();
             }
-            pending_tasks.back()->awaiting.resume();
+            {
+                CancellationScope scope{pending_tasks.back()->data.stop_token};
+                pending_tasks.back()->awaiting.resume();
+            }
             local_task_count = task_count.fetch_sub(pending_tasks.size()) - pending_tasks.size();
         }
         else
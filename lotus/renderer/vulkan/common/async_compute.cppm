@@ -2,6 +2,7 @@ module;
 
 #include <atomic>
 #include <memory>
+#include <stop_token>
 
 module lotus:renderer.vulkan.common.async_compute;
 
@@ -28,6 +29,8 @@ private:
     {
         vk::UniqueCommandBuffer buffer;
         std::unique_ptr<WorkerPool::ScheduledTask> scheduled_task;
+        // the awaiting task's, since it's resumed from whichever thread sees the fence
+        std::stop_token stop_token;
     };
     AsyncQueue<QueueItem> tasks;
     std::atomic<uint64_t> task_count;
@@ -67,10 +67,10 @@ public:
 
 private:
     vk::DescriptorSet set;
-    SharedLinkedList<vk::WriteDescriptorSet> writes;
-    SharedLinkedList<DescriptorInfo> write_info;
+    LockedQueue<vk::WriteDescriptorSet> writes;
+    LockedQueue<DescriptorInfo> write_info;
     std::atomic<uint32_t> max_index{0};
-    SharedLinkedList<uint32_t> free_indices;
+    LockedQueue<uint32_t> free_indices;
 
     void addWriteInfo(uint32_t index, DescriptorInfo _info)
     {
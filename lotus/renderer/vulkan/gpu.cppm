@@ -3,6 +3,7 @@ module;
 #include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <span>
@@ -34,6 +35,13 @@ public:
     uint32_t graphics_queue_index;
     uint32_t present_queue_index;
     uint32_t compute_queue_index;
+    // held for every submit: the queues above are each the first of their family, and the families can be the same,
+    //  so they may all be one VkQueue (which only one thread can use at a time)
+    std::mutex queue_mutex;
+    // whether present_queue is the same VkQueue as graphics_queue or async_compute_queue (usually so, since most
+    //  graphics families can present).  presenting only takes queue_mutex in that case - a present can block until
+    //  vsync, and holding the lock through it would stall every other submit for up to a refresh
+    bool present_queue_shared{true};
     std::unique_ptr<MemoryManager> memory_manager;
 
     vk::Format getDepthFormat() const;
@@ -216,6 +224,7 @@ void GPU::createDevice()
     graphics_queue = device->getQueue(graphics_queue_index, 0);
     present_queue = device->getQueue(present_queue_index, 0);
     async_compute_queue = device->getQueue(compute_queue_index, 0);
+    present_queue_shared = present_queue == graphics_queue || present_queue == async_compute_queue;
 }
 
 std::tuple<std::optional<uint32_t>, std::optional<std::uint32_t>, std::optional<std::uint32_t>> GPU::getQueueFamilies(vk::PhysicalDevice device) const
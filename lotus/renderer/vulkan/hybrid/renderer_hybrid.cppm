@@ -1,6 +1,7 @@
 module;
 
 #include <memory>
+#include <optional>
 #include <vector>
 
 module lotus:renderer.vulkan.renderer.hybrid;
@@ -23,7 +24,7 @@ public:
     virtual Task<> Init() override;
     WorkerTask<> InitWork();
 
-    virtual Task<> drawFrame() override;
+    virtual Task<std::optional<FrameSubmission>> drawFrame() override;
 
     virtual vk::Pipeline createGraphicsPipeline(vk::GraphicsPipelineCreateInfo& info) override;
     virtual vk::Pipeline createParticlePipeline(vk::GraphicsPipelineCreateInfo& info) override;
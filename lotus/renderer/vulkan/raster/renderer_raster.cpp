@@ -6,6 +6,7 @@ module;
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <vector>
 
 module lotus;
@@ -851,14 +852,19 @@ std::vector<vk::CommandBuffer> RendererRasterization::getRenderCommandbuffers()
     return render_buffers;
 }
 
-Task<> RendererRasterization::drawFrame()
+Task<std::optional<Renderer::FrameSubmission>> RendererRasterization::drawFrame()
 {
+    if (resize)
+    {
+        resize = false;
+        co_await resizeRenderer();
+    }
+
     if (!engine->game || !engine->game->scene)
-        co_return;
+        co_return std::nullopt;
 
     global_descriptors->updateDescriptorSet();
 
-    engine->worker_pool->deleteFinished();
     uint64_t frame_ready_value = timeline_sem_base[current_frame] + timeline_frame_ready;
     gpu->device->waitSemaphores({.semaphoreCount = 1, .pSemaphores = &*frame_timeline_sem[current_frame], .pValues = &frame_ready_value},
                                 std::numeric_limits<uint64_t>::max());
@@ -874,6 +880,7 @@ Task<> RendererRasterization::drawFrame()
     {
     }
 
+    std::optional<FrameSubmission> frame;
     try
     {
         engine->worker_pool->clearProcessed(current_frame);
@@ -884,57 +891,37 @@ Task<> RendererRasterization::drawFrame()
         updateCameraBuffers();
         engine->lights->UpdateLightBuffer();
 
+        frame.emplace(FrameSubmission{.image = current_image});
         auto buffers_temp = engine->worker_pool->getPrimaryGraphicsBuffers(current_frame);
         auto render_buffers = getRenderCommandbuffers();
-        std::vector<vk::CommandBufferSubmitInfoKHR> buffers;
-        buffers.resize(buffers_temp.size() + render_buffers.size());
-        std::ranges::transform(buffers_temp, buffers.begin(), [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
-        std::ranges::transform(render_buffers, buffers.begin() + buffers_temp.size(),
+        frame->buffers.resize(buffers_temp.size() + render_buffers.size());
+        std::ranges::transform(buffers_temp, frame->buffers.begin(), [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
+        std::ranges::transform(render_buffers, frame->buffers.begin() + buffers_temp.size(),
                                [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
 
-        vk::SemaphoreSubmitInfoKHR graphics_sem{.semaphore = *frame_timeline_sem[current_frame],
-                                                .value = timeline_sem_base[current_frame] + timeline_graphics,
-                                                .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
+        frame->graphics_sem = {.semaphore = *frame_timeline_sem[current_frame],
+                               .value = timeline_sem_base[current_frame] + timeline_graphics,
+                               .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
 
         auto deferred_buffer = getDeferredCommandBuffer();
         auto ui_buffers = ui->Render();
-        std::vector<vk::CommandBufferSubmitInfoKHR> deferred_buffers{{.commandBuffer = *deferred_buffer}};
-        deferred_buffers.resize(1 + ui_buffers.size());
-        std::ranges::transform(ui_buffers, deferred_buffers.begin() + 1, [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
-        deferred_buffers.push_back({.commandBuffer = prepareDeferredImageForPresent()});
+        frame->deferred_buffers = {{.commandBuffer = *deferred_buffer}};
+        frame->deferred_buffers.resize(1 + ui_buffers.size());
+        std::ranges::transform(ui_buffers, frame->deferred_buffers.begin() + 1,
+                               [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
+        frame->deferred_buffers.push_back({.commandBuffer = prepareDeferredImageForPresent()});
 
-        std::array deferred_waits{graphics_sem, vk::SemaphoreSubmitInfoKHR{.semaphore = *image_ready_sem[current_frame],
-                                                                           .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
+        frame->deferred_waits = {frame->graphics_sem, vk::SemaphoreSubmitInfoKHR{.semaphore = *image_ready_sem[current_frame],
+                                                                                 .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
 
-        std::array deferred_signals{
+        frame->deferred_signals = {
             vk::SemaphoreSubmitInfoKHR{.semaphore = *frame_timeline_sem[current_frame],
                                        .value = timeline_sem_base[current_frame] + timeline_frame_ready,
                                        .stageMask = vk::PipelineStageFlagBits2::eAllCommands},
             vk::SemaphoreSubmitInfoKHR{.semaphore = *frame_finish_sem[current_image], .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
 
-        gpu->graphics_queue.submit2({vk::SubmitInfo2{.commandBufferInfoCount = static_cast<uint32_t>(buffers.size()),
-                                                     .pCommandBufferInfos = buffers.data(),
-                                                     .signalSemaphoreInfoCount = 1,
-                                                     .pSignalSemaphoreInfos = &graphics_sem},
-                                     vk::SubmitInfo2{.waitSemaphoreInfoCount = deferred_waits.size(),
-                                                     .pWaitSemaphoreInfos = deferred_waits.data(),
-                                                     .commandBufferInfoCount = static_cast<uint32_t>(deferred_buffers.size()),
-                                                     .pCommandBufferInfos = deferred_buffers.data(),
-                                                     .signalSemaphoreInfoCount = deferred_signals.size(),
-                                                     .pSignalSemaphoreInfos = deferred_signals.data()}});
-
-        engine->worker_pool->gpuResource(std::move(deferred_buffer));
-
-        std::vector<vk::Semaphore> present_waits{*frame_finish_sem[current_image]};
-        std::vector<vk::SwapchainKHR> swap_chains = {*swapchain->swapchain};
-
-        co_await engine->worker_pool->mainThread();
-
-        gpu->present_queue.presentKHR({.waitSemaphoreCount = static_cast<uint32_t>(present_waits.size()),
-                                       .pWaitSemaphores = present_waits.data(),
-                                       .swapchainCount = static_cast<uint32_t>(swap_chains.size()),
-                                       .pSwapchains = swap_chains.data(),
-                                       .pImageIndices = &current_image});
+        frame->present_wait = *frame_finish_sem[current_image];
+        frame->owned_buffers.push_back(std::move(deferred_buffer));
 
         previous_frame = current_frame;
         current_frame = (current_frame + 1) % max_pending_frames;
@@ -942,13 +929,10 @@ Task<> RendererRasterization::drawFrame()
     catch (vk::OutOfDateKHRError&)
     {
         resize = true;
+        frame.reset();
     }
 
-    if (resize)
-    {
-        resize = false;
-        co_await resizeRenderer();
-    }
+    co_return frame;
 }
 
 vk::Pipeline lotus::RendererRasterization::createGraphicsPipeline(vk::GraphicsPipelineCreateInfo& info)
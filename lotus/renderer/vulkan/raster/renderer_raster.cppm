@@ -1,6 +1,7 @@
 module;
 
 #include <memory>
+#include <optional>
 #include <vector>
 
 module lotus:renderer.vulkan.renderer.raster;
@@ -20,7 +21,7 @@ public:
 
     virtual Task<> Init() override;
 
-    virtual Task<> drawFrame() override;
+    virtual Task<std::optional<FrameSubmission>> drawFrame() override;
 
     vk::UniqueHandle<vk::RenderPass, vk::DispatchLoaderDynamic> shadowmap_render_pass;
     vk::UniqueHandle<vk::DescriptorSetLayout, vk::DispatchLoaderDynamic> shadowmap_descriptor_set_layout;
@@ -4,6 +4,7 @@ module;
 #include <coroutine>
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <vector>
 
 module lotus;
@@ -728,12 +729,17 @@ vk::CommandBuffer RendererRaytrace::getRenderCommandbuffer()
     return *render_commandbuffers[current_frame];
 }
 
-Task<> RendererRaytrace::drawFrame()
+Task<std::optional<Renderer::FrameSubmission>> RendererRaytrace::drawFrame()
 {
+    if (resize)
+    {
+        resize = false;
+        co_await resizeRenderer();
+    }
+
     if (!engine->game || !engine->game->scene)
-        co_return;
+        co_return std::nullopt;
 
-    engine->worker_pool->deleteFinished();
     uint64_t frame_ready_value = timeline_sem_base[current_frame] + timeline_frame_ready;
     gpu->device->waitSemaphores({.semaphoreCount = 1, .pSemaphores = &*frame_timeline_sem[current_frame], .pValues = &frame_ready_value},
                                 std::numeric_limits<uint64_t>::max());
@@ -762,77 +768,46 @@ Task<> RendererRaytrace::drawFrame()
                                                    uniform_buffer_align_up(sizeof(Component::CameraComponent::CameraData)) * current_frame));
     engine->lights->UpdateLightBuffer();
 
+    FrameSubmission frame{.image = current_image};
     auto buffers_temp = engine->worker_pool->getPrimaryGraphicsBuffers(current_frame);
-    std::vector<vk::CommandBufferSubmitInfoKHR> buffers;
-    buffers.resize(buffers_temp.size());
-    std::ranges::transform(buffers_temp, buffers.begin(), [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
-    buffers.push_back({.commandBuffer = getRenderCommandbuffer()});
+    frame.buffers.resize(buffers_temp.size());
+    std::ranges::transform(buffers_temp, frame.buffers.begin(), [](auto buffer) { return vk::CommandBufferSubmitInfoKHR{.commandBuffer = buffer}; });
+    frame.buffers.push_back({.commandBuffer = getRenderCommandbuffer()});
     // post process
     auto post_buffer = post_process->getCommandBuffer(*gbuffer.light.image_view, *gbuffer.normal.image_view, *gbuffer.motion_vector.image_view);
-    buffers.push_back({.commandBuffer = *post_buffer});
+    frame.buffers.push_back({.commandBuffer = *post_buffer});
 
-    vk::SemaphoreSubmitInfoKHR graphics_sem{.semaphore = *frame_timeline_sem[current_frame],
-                                            .value = timeline_sem_base[current_frame] + timeline_graphics,
-                                            .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
+    frame.graphics_sem = {.semaphore = *frame_timeline_sem[current_frame],
+                          .value = timeline_sem_base[current_frame] + timeline_graphics,
+                          .stageMask = vk::PipelineStageFlagBits2::eAllCommands};
 
     // deferred render
     auto deferred_buffer = getDeferredCommandBuffer();
     auto ui_buffers = ui->Render();
-    std::vector<vk::CommandBufferSubmitInfoKHR> deferred_buffers{{.commandBuffer = *deferred_buffer}};
+    frame.deferred_buffers = {{.commandBuffer = *deferred_buffer}};
     // deferred_buffers.resize(1 + ui_buffers.size());
     // std::ranges::transform(ui_buffers, deferred_buffers.begin() + 1, [](auto buffer) { return
     // vk::CommandBufferSubmitInfoKHR{ .commandBuffer = buffer }; });
-    deferred_buffers.push_back({.commandBuffer = prepareDeferredImageForPresent()});
+    frame.deferred_buffers.push_back({.commandBuffer = prepareDeferredImageForPresent()});
 
-    std::array deferred_waits{graphics_sem, vk::SemaphoreSubmitInfoKHR{.semaphore = *image_ready_sem[current_frame],
-                                                                       .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
+    frame.deferred_waits = {frame.graphics_sem, vk::SemaphoreSubmitInfoKHR{.semaphore = *image_ready_sem[current_frame],
+                                                                           .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
 
-    std::array deferred_signals{
+    frame.deferred_signals = {
         vk::SemaphoreSubmitInfoKHR{.semaphore = *frame_timeline_sem[current_frame],
                                    .value = timeline_sem_base[current_frame] + timeline_frame_ready,
                                    .stageMask = vk::PipelineStageFlagBits2::eAllCommands},
         vk::SemaphoreSubmitInfoKHR{.semaphore = *frame_finish_sem[current_image], .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput}};
 
-    gpu->graphics_queue.submit2({vk::SubmitInfo2{.commandBufferInfoCount = static_cast<uint32_t>(buffers.size()),
-                                                 .pCommandBufferInfos = buffers.data(),
-                                                 .signalSemaphoreInfoCount = 1,
-                                                 .pSignalSemaphoreInfos = &graphics_sem},
-                                 vk::SubmitInfo2{.waitSemaphoreInfoCount = deferred_waits.size(),
-                                                 .pWaitSemaphoreInfos = deferred_waits.data(),
-                                                 .commandBufferInfoCount = static_cast<uint32_t>(deferred_buffers.size()),
-                                                 .pCommandBufferInfos = deferred_buffers.data(),
-                                                 .signalSemaphoreInfoCount = deferred_signals.size(),
-                                                 .pSignalSemaphoreInfos = deferred_signals.data()}});
-
-    engine->worker_pool->gpuResource(std::move(post_buffer), std::move(deferred_buffer));
-
-    std::vector<vk::Semaphore> present_waits{*frame_finish_sem[current_image]};
-    std::vector<vk::SwapchainKHR> swap_chains = {*swapchain->swapchain};
-
-    co_await engine->worker_pool->mainThread();
-
-    try
-    {
-        gpu->present_queue.presentKHR({.waitSemaphoreCount = static_cast<uint32_t>(present_waits.size()),
-                                       .pWaitSemaphores = present_waits.data(),
-                                       .swapchainCount = static_cast<uint32_t>(swap_chains.size()),
-                                       .pSwapchains = swap_chains.data(),
-                                       .pImageIndices = &current_image});
-    }
-    catch (vk::OutOfDateKHRError&)
-    {
-    }
+    frame.present_wait = *frame_finish_sem[current_image];
+    frame.owned_buffers.push_back(std::move(post_buffer));
+    frame.owned_buffers.push_back(std::move(deferred_buffer));
 
     previous_frame = current_frame;
     current_frame = (current_frame + 1) % max_pending_frames;
-    frame_ready_value = timeline_sem_base[current_frame] + timeline_frame_ready;
 
     raytracer->prepareNextFrame();
 
-    if (resize)
-    {
-        resize = false;
-        co_await resizeRenderer();
-    }
+    co_return frame;
 }
 } // namespace lotus
@@ -1,6 +1,7 @@
 module;
 
 #include <memory>
+#include <optional>
 #include <vector>
 
 module lotus:renderer.vulkan.renderer.raytrace;
@@ -23,7 +24,7 @@ public:
     virtual Task<> Init() override;
     WorkerTask<> InitWork();
 
-    virtual Task<> drawFrame() override;
+    virtual Task<std::optional<FrameSubmission>> drawFrame() override;
 
     std::unique_ptr<Image> depth_image;
     vk::UniqueImageView depth_image_view;
@@ -1,12 +1,15 @@
 module;
 
+#include <algorithm>
 #include <coroutine>
 #include <cstring>
 #include <format>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 #include <vulkan/vulkan_hpp_macros.hpp>
 
@@ -72,6 +75,9 @@ Renderer::~Renderer() { gpu->device->waitIdle(); }
 
 Task<> Renderer::InitCommon()
 {
+    upload_ring = std::make_unique<UploadRing>(gpu->memory_manager.get(), getFrameCount(), engine->settings.renderer_settings.upload_ring_size,
+                                               gpu->properties.properties.limits.minUniformBufferOffsetAlignment,
+                                               gpu->properties.properties.limits.minStorageBufferOffsetAlignment);
     raytrace_queryer = std::make_unique<RaytraceQueryer>(engine);
     ui = std::make_unique<UiRenderer>(engine, this);
     co_await ui->Init();
@@ -168,7 +174,14 @@ void Renderer::createAnimationResources()
     vertex_out_buffer.pImmutableSamplers = nullptr;
     vertex_out_buffer.stageFlags = vk::ShaderStageFlagBits::eCompute;
 
-    std::vector<vk::DescriptorSetLayoutBinding> descriptor_bindings = {vertex_info_buffer, skeleton_info_buffer, vertex_out_buffer};
+    vk::DescriptorSetLayoutBinding dispatch_buffer;
+    dispatch_buffer.binding = 3;
+    dispatch_buffer.descriptorCount = 1;
+    dispatch_buffer.descriptorType = vk::DescriptorType::eStorageBuffer;
+    dispatch_buffer.pImmutableSamplers = nullptr;
+    dispatch_buffer.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    std::vector<vk::DescriptorSetLayoutBinding> descriptor_bindings = {vertex_info_buffer, skeleton_info_buffer, vertex_out_buffer, dispatch_buffer};
 
     vk::DescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.flags = vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptor;
@@ -184,7 +197,7 @@ void Renderer::createAnimationResources()
     pipeline_layout_ci.pSetLayouts = layouts.data();
 
     vk::PushConstantRange push_constants;
-    push_constants.size = sizeof(uint32_t);
+    push_constants.size = sizeof(uint32_t) * 2;
     push_constants.offset = 0;
     push_constants.stageFlags = vk::ShaderStageFlagBits::eCompute;
 
@@ -207,6 +220,11 @@ void Renderer::createAnimationResources()
     pipeline_ci.stage = animation_shader_stage_info;
 
     animation_pipeline = gpu->device->createComputePipelineUnique(nullptr, pipeline_ci, nullptr).value;
+
+    animation_shader_stage_info.pName = "SkinBatched";
+    pipeline_ci.stage = animation_shader_stage_info;
+
+    animation_batch_pipeline = gpu->device->createComputePipelineUnique(nullptr, pipeline_ci, nullptr).value;
 }
 
 Task<> Renderer::resizeRenderer()
@@ -252,6 +270,10 @@ Renderer::ThreadLocals Renderer::createThreadLocals()
 {
     graphics_pool = gpu->createCommandPool(GPU::QueueType::Graphics, {});
     compute_pool = gpu->createCommandPool(GPU::QueueType::Compute, {});
+    for (auto& transient : transient_pools)
+    {
+        transient.pool = gpu->createCommandPool(GPU::QueueType::Graphics, vk::CommandPoolCreateFlagBits::eTransient);
+    }
 
     std::array<vk::DescriptorPoolSize, 2> poolSizes = {};
     poolSizes[0].type = vk::DescriptorType::eUniformBuffer;
@@ -277,6 +299,38 @@ void Renderer::deleteThreadLocals()
     engine->renderer->shutdown_command_pools.push_back(std::move(engine->renderer->graphics_pool));
     engine->renderer->shutdown_command_pools.push_back(std::move(engine->renderer->compute_pool));
     engine->renderer->shutdown_descriptor_pools.push_back(std::move(engine->renderer->desc_pool));
+    for (auto& transient : transient_pools)
+    {
+        engine->renderer->shutdown_command_pools.push_back(std::move(transient.pool));
+    }
+}
+
+vk::CommandBuffer Renderer::getTransientCommandBuffer(vk::CommandBufferLevel level)
+{
+    const auto epoch = transient_epoch.load(std::memory_order::acquire);
+    auto& transient = transient_pools[epoch % transient_pools.size()];
+    if (transient.epoch != epoch)
+    {
+        // last recorded from max_pending_frames + 1 frames ago, so all of it has completed by now
+        gpu->device->resetCommandPool(*transient.pool);
+        transient.used = {};
+        transient.epoch = epoch;
+    }
+    auto& buffers = transient.buffers[static_cast<size_t>(level)];
+    auto& used = transient.used[static_cast<size_t>(level)];
+    if (used == buffers.size())
+    {
+        auto more = gpu->device->allocateCommandBuffers(
+            {.commandPool = *transient.pool, .level = level, .commandBufferCount = static_cast<uint32_t>(std::max<size_t>(buffers.size(), 8))});
+        buffers.insert(buffers.end(), more.begin(), more.end());
+    }
+    return buffers[used++];
+}
+
+void Renderer::beginTransientFrame()
+{
+    transient_epoch.fetch_add(1, std::memory_order::release);
+    upload_ring->beginFrame();
 }
 
 vk::UniqueHandle<vk::ShaderModule, vk::DispatchLoaderDynamic> Renderer::getShader(const std::string& file_name)
@@ -434,4 +488,78 @@ vk::CommandBuffer Renderer::prepareDeferredImageForPresent()
 }
 
 vk::Extent2D Renderer::getExtent() const { return swapchain->extent; }
+
+WorkerTask<> Renderer::submitFrame(FrameSubmission frame)
+{
+    // marked before the worker picks the submission up, so the next tick's queries can't get ahead of it
+    {
+        std::lock_guard lk{submission_mutex};
+        submission_pending = true;
+    }
+    return submitQueued(std::move(frame));
+}
+
+WorkerTask<> Renderer::submitQueued(FrameSubmission frame)
+{
+    std::unique_lock queue_lock{gpu->queue_mutex};
+    gpu->graphics_queue.submit2({vk::SubmitInfo2{.commandBufferInfoCount = static_cast<uint32_t>(frame.buffers.size()),
+                                                 .pCommandBufferInfos = frame.buffers.data(),
+                                                 .signalSemaphoreInfoCount = 1,
+                                                 .pSignalSemaphoreInfos = &frame.graphics_sem},
+                                 vk::SubmitInfo2{.waitSemaphoreInfoCount = frame.deferred_waits.size(),
+                                                 .pWaitSemaphoreInfos = frame.deferred_waits.data(),
+                                                 .commandBufferInfoCount = static_cast<uint32_t>(frame.deferred_buffers.size()),
+                                                 .pCommandBufferInfos = frame.deferred_buffers.data(),
+                                                 .signalSemaphoreInfoCount = frame.deferred_signals.size(),
+                                                 .pSignalSemaphoreInfos = frame.deferred_signals.data()}});
+    queue_lock.unlock();
+
+    std::vector<SubmissionAwaiter*> waiters;
+    {
+        std::lock_guard lk{submission_mutex};
+        submission_pending = false;
+        waiters = std::exchange(submission_waiters, {});
+    }
+    for (auto* waiter : waiters)
+        waiter->task->queueTask();
+
+    engine->worker_pool->gpuResource(std::move(frame.owned_buffers));
+
+    co_await engine->worker_pool->mainThread();
+
+    try
+    {
+        // a present queue of its own is only ever used from here, on the main thread, so it can block on vsync without
+        //  holding up anyone's submits.  when it's the graphics or compute queue, it has to be locked like any submit
+        std::unique_lock present_lock{gpu->queue_mutex, std::defer_lock};
+        if (gpu->present_queue_shared)
+            present_lock.lock();
+        gpu->present_queue.presentKHR({.waitSemaphoreCount = 1,
+                                       .pWaitSemaphores = &frame.present_wait,
+                                       .swapchainCount = 1,
+                                       .pSwapchains = &*swapchain->swapchain,
+                                       .pImageIndices = &frame.image});
+    }
+    catch (vk::OutOfDateKHRError&)
+    {
+        resize = true;
+    }
+}
+Task<> Renderer::waitForSubmission() { co_await SubmissionAwaiter{this}; }
+
+bool Renderer::SubmissionAwaiter::await_ready()
+{
+    std::lock_guard lk{renderer->submission_mutex};
+    return !renderer->submission_pending;
+}
+
+bool Renderer::SubmissionAwaiter::await_suspend(std::coroutine_handle<> awaiter)
+{
+    std::lock_guard lk{renderer->submission_mutex};
+    if (!renderer->submission_pending)
+        return false;
+    task.emplace(renderer->engine->worker_pool.get(), awaiter);
+    renderer->submission_waiters.push_back(this);
+    return true;
+}
 } // namespace lotus
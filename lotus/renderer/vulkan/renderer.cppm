@@ -1,6 +1,12 @@
 module;
 
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 #include <vulkan/vulkan_hpp_macros.hpp>
@@ -19,6 +25,7 @@ import :renderer.vulkan.pipelines.raytrace;
 import :renderer.vulkan.gpu;
 import :renderer.vulkan.swapchain;
 import :renderer.vulkan.ui_renderer;
+import :renderer.vulkan.upload_ring;
 import :renderer.vulkan.window;
 import :util;
 import glm;
@@ -34,6 +41,17 @@ class RendererRaytrace;
 class RendererRasterization;
 class RendererHybrid;
 
+// one thread's command pool for one frame's transient command buffers
+//  (zero initialised - the renderer keeps these as thread_locals)
+struct TransientCommandPool
+{
+    vk::UniqueCommandPool pool;
+    uint64_t epoch;
+    // indexed by vk::CommandBufferLevel
+    std::array<std::vector<vk::CommandBuffer>, 2> buffers;
+    std::array<size_t, 2> used;
+};
+
 export class Renderer
 {
 public:
@@ -85,7 +103,31 @@ public:
 
     vk::Extent2D getExtent() const;
 
-    virtual Task<> drawFrame() = 0;
+    // A frame recorded by drawFrame, waiting to be submitted and presented
+    //  everything the simulation produced for the frame has already been written into this frame's buffers (UBOs,
+    //  camera, lights, TLAS) and recorded into command buffers, so submitFrame only touches what's in here and the
+    //  next frame can be simulated while it runs
+    struct FrameSubmission
+    {
+        std::vector<vk::CommandBufferSubmitInfoKHR> buffers;
+        std::vector<vk::CommandBufferSubmitInfoKHR> deferred_buffers;
+        vk::SemaphoreSubmitInfoKHR graphics_sem;
+        std::array<vk::SemaphoreSubmitInfoKHR, 2> deferred_waits;
+        std::array<vk::SemaphoreSubmitInfoKHR, 2> deferred_signals;
+        vk::Semaphore present_wait;
+        uint32_t image;
+        // retired once submitted
+        std::vector<vk::UniqueCommandBuffer> owned_buffers;
+    };
+
+    // record the current frame from the simulation's state, and move on to the next frame (nullopt if there's
+    //  nothing to draw)
+    virtual Task<std::optional<FrameSubmission>> drawFrame() = 0;
+    WorkerTask<> submitFrame(FrameSubmission frame);
+    // resumes on a worker once the frame last passed to submitFrame is on the graphics queue, so GPU work that reads
+    //  what that frame built (like its TLAS) is queued after it
+    [[nodiscard]]
+    Task<> waitForSubmission();
 
     void resized() { resize = true; }
 
@@ -101,6 +143,7 @@ public:
     std::unique_ptr<GPU> gpu;
     std::unique_ptr<Swapchain> swapchain;
     std::unique_ptr<AsyncCompute> async_compute;
+    std::unique_ptr<UploadRing> upload_ring;
 
     std::unique_ptr<GlobalDescriptors> global_descriptors;
 
@@ -109,6 +152,13 @@ public:
 
     inline static thread_local vk::UniqueDescriptorPool desc_pool;
 
+    // A command buffer for work submitted with the frame currently being recorded, from this thread's pool for it
+    //  instead of being freed one at a time, the whole pool is reset once its frame has completed on the GPU, so
+    //  the buffer must not be retired through gpuResource
+    vk::CommandBuffer getTransientCommandBuffer(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+    // the oldest frame in flight has completed - start handing out the next frame's transient resources
+    void beginTransientFrame();
+
     std::unique_ptr<Image> deferred_image;
     vk::UniqueHandle<vk::ImageView, vk::DispatchLoaderDynamic> deferred_image_view;
 
@@ -141,6 +191,28 @@ protected:
     vk::UniqueCommandPool command_pool;
     std::vector<vk::UniqueCommandBuffer> present_buffers;
 
+    WorkerTask<> submitQueued(FrameSubmission frame);
+
+    class SubmissionAwaiter
+    {
+    public:
+        SubmissionAwaiter(Renderer* _renderer) : renderer(_renderer) {}
+
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> awaiter);
+        void await_resume() { CancellationScope::throwIfCancelled(); }
+
+    private:
+        friend class Renderer;
+        Renderer* renderer;
+        // queued once the frame is submitted
+        std::optional<WorkerPool::ScheduledTask> task;
+    };
+
+    std::mutex submission_mutex;
+    bool submission_pending{false};
+    std::vector<SubmissionAwaiter*> submission_waiters;
+
 public:
     struct FramebufferAttachment
     {
@@ -154,6 +226,8 @@ public:
     vk::UniqueDescriptorSetLayout animation_descriptor_set_layout;
     vk::UniquePipelineLayout animation_pipeline_layout;
     vk::UniquePipeline animation_pipeline;
+    // skins every deformed mesh in one go (see DeformedMeshComponent::Stage)
+    vk::UniquePipeline animation_batch_pipeline;
     /* Animation pipeline */
 
     std::unique_ptr<RaytraceQueryer> raytrace_queryer;
@@ -193,6 +267,10 @@ protected:
     uint32_t current_frame{0};
     uint32_t previous_frame{0};
 
+    // pools are used in turn, one per frame in flight plus the one being recorded
+    inline static thread_local std::array<TransientCommandPool, max_pending_frames + 1> transient_pools;
+    std::atomic<uint64_t> transient_epoch{0};
+
     bool resize{false};
 };
 } // namespace lotus
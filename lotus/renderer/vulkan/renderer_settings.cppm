@@ -9,5 +9,8 @@ export namespace lotus
 struct RendererSettings
 {
     uint32_t shadowmap_dimension{2048};
+    // bytes of transient uploads (uniforms, staging) each frame can allocate from the UploadRing before it spills
+    //  into overflow buffers
+    uint32_t upload_ring_size{16 * 1024 * 1024};
 };
 } // namespace lotus
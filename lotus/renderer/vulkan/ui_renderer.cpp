@@ -38,11 +38,9 @@ Task<> UiRenderer::ReInit()
 std::vector<vk::CommandBuffer> UiRenderer::Render()
 {
     std::vector<vk::CommandBuffer> render_buffers;
-    vk::CommandBufferAllocateInfo alloc_info{.commandPool = *renderer->graphics_pool, .level = vk::CommandBufferLevel::ePrimary, .commandBufferCount = 2};
+    std::array buffers{renderer->getTransientCommandBuffer(), renderer->getTransientCommandBuffer()};
 
-    auto buffers = renderer->gpu->device->allocateCommandBuffersUnique(alloc_info);
-
-    buffers[0]->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    buffers[0].begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
     auto image = renderer->getCurrentImage();
 
@@ -58,37 +56,36 @@ std::vector<vk::CommandBuffer> UiRenderer::Render()
                                               .storeOp = vk::AttachmentStoreOp::eDontCare,
                                               .clearValue = {.depthStencil = vk::ClearDepthStencilValue{1.0f, 0}}};
 
-    buffers[0]->beginRendering({.flags = vk::RenderingFlagBits::eSuspending,
-                                   .renderArea = {.extent = renderer->swapchain->extent},
-                                   .layerCount = 1,
-                                   .viewMask = 0,
-                                   .colorAttachmentCount = colour_attachments.size(),
-                                   .pColorAttachments = colour_attachments.data(),
-                                   .pDepthAttachment = &depth_info});
-    buffers[0]->endRendering();
-    buffers[0]->end();
+    buffers[0].beginRendering({.flags = vk::RenderingFlagBits::eSuspending,
+                                  .renderArea = {.extent = renderer->swapchain->extent},
+                                  .layerCount = 1,
+                                  .viewMask = 0,
+                                  .colorAttachmentCount = colour_attachments.size(),
+                                  .pColorAttachments = colour_attachments.data(),
+                                  .pDepthAttachment = &depth_info});
+    buffers[0].endRendering();
+    buffers[0].end();
 
     auto ui_buffers = engine->ui->getRenderCommandBuffers(image);
     render_buffers.resize(2 + ui_buffers.size());
-    render_buffers[0] = *buffers[0];
+    render_buffers[0] = buffers[0];
     std::ranges::copy(ui_buffers, render_buffers.begin() + 1);
 
-    buffers[1]->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    buffers[1].begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
 
-    buffers[1]->beginRendering({.flags = vk::RenderingFlagBits::eResuming,
-                                   .renderArea = {.extent = renderer->swapchain->extent},
-                                   .layerCount = 1,
-                                   .viewMask = 0,
-                                   .colorAttachmentCount = colour_attachments.size(),
-                                   .pColorAttachments = colour_attachments.data(),
-                                   .pDepthAttachment = &depth_info});
-    buffers[1]->endRendering();
+    buffers[1].beginRendering({.flags = vk::RenderingFlagBits::eResuming,
+                                  .renderArea = {.extent = renderer->swapchain->extent},
+                                  .layerCount = 1,
+                                  .viewMask = 0,
+                                  .colorAttachmentCount = colour_attachments.size(),
+                                  .pColorAttachments = colour_attachments.data(),
+                                  .pDepthAttachment = &depth_info});
+    buffers[1].endRendering();
 
-    buffers[1]->end();
+    buffers[1].end();
 
-    render_buffers.back() = *buffers[1];
+    render_buffers.back() = buffers[1];
 
-    engine->worker_pool->gpuResource(std::move(buffers));
     return render_buffers;
 }
 
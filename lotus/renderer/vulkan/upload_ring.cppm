@@ -0,0 +1,174 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+export module lotus:renderer.vulkan.upload_ring;
+
+import :renderer.memory;
+import vulkan_hpp;
+
+export namespace lotus
+{
+// Linear allocator for data the CPU writes fresh every frame (uniforms, small storage buffers, staging)
+//  one persistently mapped buffer is split into a segment per frame in flight, plus the one currently being filled.
+//  threads claim blocks from the filling segment with a single atomic add, and suballocate from their own block
+//  without touching any shared state.  everything allocated between two beginFrame() calls belongs to the later
+//  frame, and its segment isn't refilled until that frame has completed on the GPU.
+//  a frame that outgrows its segment carries on in overflow buffers, which are held with the segment and recycled
+//  once it comes around again, so a large scene costs a few extra buffers rather than failing
+class UploadRing
+{
+public:
+    struct Allocation
+    {
+        vk::Buffer buffer;
+        vk::DeviceSize offset{0};
+        vk::DeviceSize size{0};
+        std::byte* mapped{nullptr};
+
+        template <typename T> T* as() const { return reinterpret_cast<T*>(mapped); }
+        vk::DescriptorBufferInfo descriptor() const { return {.buffer = buffer, .offset = offset, .range = size}; }
+    };
+
+    UploadRing(MemoryManager* _memory_manager, uint32_t frame_count, vk::DeviceSize _segment_size, vk::DeviceSize _uniform_alignment,
+               vk::DeviceSize _storage_alignment)
+        : segment_count(frame_count + 1), segment_size(align(_segment_size, block_size)), uniform_alignment(_uniform_alignment),
+          storage_alignment(_storage_alignment), memory_manager(_memory_manager), overflow(segment_count)
+    {
+        buffer = createBuffer(segment_size * segment_count);
+        mapped = static_cast<std::byte*>(buffer->map(0, segment_size * segment_count, {}));
+    }
+    ~UploadRing()
+    {
+        buffer->unmap();
+        for (auto& segment_overflow : overflow)
+        {
+            for (auto& block : segment_overflow)
+                block.buffer->unmap();
+        }
+        for (auto& block : free_overflow)
+            block.buffer->unmap();
+    }
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    // only valid for work submitted with the frame it was allocated for
+    Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16)
+    {
+        const auto epoch = cursor.load(std::memory_order::acquire) >> fill_bits;
+        auto offset = align(thread_block.offset, alignment);
+        if (thread_block.ring != this || thread_block.epoch != epoch || offset + size > thread_block.end)
+        {
+            const auto claim = std::max(block_size, align(size + alignment, block_size));
+            const auto previous = cursor.fetch_add(claim, std::memory_order::relaxed);
+            const auto fill = previous & fill_mask;
+            const auto block_epoch = previous >> fill_bits;
+            if (fill + claim <= segment_size)
+            {
+                const auto base = (block_epoch % segment_count) * segment_size + fill;
+                thread_block = {.ring = this, .epoch = block_epoch, .buffer = buffer->buffer, .mapped = mapped, .offset = base, .end = base + claim};
+            }
+            else
+            {
+                thread_block = overflowBlock(block_epoch, claim);
+            }
+            offset = align(thread_block.offset, alignment);
+        }
+        thread_block.offset = offset + size;
+        return {.buffer = thread_block.buffer, .offset = offset, .size = size, .mapped = thread_block.mapped + offset};
+    }
+    Allocation allocateUniform(vk::DeviceSize size) { return allocate(size, uniform_alignment); }
+    Allocation allocateStorage(vk::DeviceSize size) { return allocate(size, storage_alignment); }
+
+    // hand everything allocated since the last call to the frame being started, and start filling the next segment
+    //  segments are used in turn, so this relies on the oldest frame in flight having been flushed first
+    void beginFrame()
+    {
+        const auto epoch = cursor.load(std::memory_order::relaxed) >> fill_bits;
+        {
+            // the segment's last frame has completed, so its overflow can be reused
+            std::lock_guard lk{overflow_mutex};
+            auto& segment_overflow = overflow[(epoch + 1) % segment_count];
+            std::ranges::move(segment_overflow, std::back_inserter(free_overflow));
+            segment_overflow.clear();
+        }
+        cursor.store((epoch + 1) << fill_bits, std::memory_order::release);
+    }
+
+private:
+    static constexpr vk::DeviceSize align(vk::DeviceSize offset, vk::DeviceSize alignment) { return (offset + alignment - 1) / alignment * alignment; }
+
+    // the cursor packs the frame's epoch (which segment is being filled) with how much of it has been claimed
+    static constexpr uint64_t fill_bits{32};
+    static constexpr uint64_t fill_mask{(uint64_t{1} << fill_bits) - 1};
+    static constexpr vk::DeviceSize block_size{64 * 1024};
+
+    // zero initialised, as a thread_local
+    struct ThreadBlock
+    {
+        const UploadRing* ring;
+        uint64_t epoch;
+        vk::Buffer buffer;
+        std::byte* mapped;
+        vk::DeviceSize offset;
+        vk::DeviceSize end;
+    };
+    static inline thread_local ThreadBlock thread_block;
+
+    struct OverflowBlock
+    {
+        std::unique_ptr<Buffer> buffer;
+        std::byte* mapped;
+    };
+
+    std::unique_ptr<Buffer> createBuffer(vk::DeviceSize size)
+    {
+        return memory_manager->GetBuffer(size,
+                                         vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+                                             vk::BufferUsageFlagBits::eTransferSrc,
+                                         vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    // the frame's segment is full - hand out a block of a separate buffer, held until the segment is next reused
+    //  (a whole segment's worth, so the threads don't come back for another one soon)
+    ThreadBlock overflowBlock(uint64_t epoch, vk::DeviceSize claim)
+    {
+        const auto size = std::max(segment_size, claim);
+        std::lock_guard lk{overflow_mutex};
+        auto& segment_overflow = overflow[epoch % segment_count];
+        if (auto free = std::ranges::find_if(free_overflow, [size](auto& block) { return block.buffer->getSize() >= size; }); free != free_overflow.end())
+        {
+            segment_overflow.push_back(std::move(*free));
+            free_overflow.erase(free);
+        }
+        else
+        {
+            auto block_buffer = createBuffer(size);
+            auto* block_mapped = static_cast<std::byte*>(block_buffer->map(0, size, {}));
+            segment_overflow.push_back({.buffer = std::move(block_buffer), .mapped = block_mapped});
+        }
+        const auto& block = segment_overflow.back();
+        return {.ring = this, .epoch = epoch, .buffer = block.buffer->buffer, .mapped = block.mapped, .offset = 0, .end = block.buffer->getSize()};
+    }
+
+    const uint64_t segment_count;
+    const vk::DeviceSize segment_size;
+    const vk::DeviceSize uniform_alignment;
+    const vk::DeviceSize storage_alignment;
+    MemoryManager* memory_manager;
+    std::unique_ptr<Buffer> buffer;
+    std::byte* mapped{nullptr};
+    std::mutex overflow_mutex;
+    // indexed by segment
+    std::vector<std::vector<OverflowBlock>> overflow;
+    std::vector<OverflowBlock> free_overflow;
+    alignas(64) std::atomic<uint64_t> cursor{0};
+};
+} // namespace lotus
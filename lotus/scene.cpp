@@ -18,23 +18,28 @@ namespace lotus
 Scene::Scene(Engine* _engine) : engine(_engine) { component_runners = std::make_unique<Component::ComponentRunners>(engine); }
 
 Task<> Scene::tick_all(time_point time, duration delta)
+{
+    co_await tick(time, delta);
+    co_await component_runners->simulate(time, delta);
+}
+
+Task<> Scene::update_all(time_point time, duration delta)
 {
     auto entities_to_add = new_entities.getAll();
     entities.insert(entities.end(), entities_to_add.begin(), entities_to_add.end());
-    co_await tick(time, delta);
-    std::vector<decltype(entities)::value_type::element_type*> entities_p{entities.size()};
-    std::ranges::transform(entities, entities_p.begin(), [](auto& c) { return c.get(); });
 
     co_await component_runners->run(time, delta);
+    // the runners have now erased the components of last tick's removed entities, so their indices can be reused
+    removed_entities.clear();
 
     auto removed = std::ranges::partition(entities, [](auto& entity) { return !entity->should_remove(); });
 
     if (std::ranges::begin(removed) != std::ranges::end(removed))
     {
-        for (const auto& e : removed)
-        {
-            component_runners->removeComponents(e.get());
-        }
+        std::vector<EntityHandle> removed_handles(std::ranges::size(removed));
+        std::ranges::transform(removed, removed_handles.begin(), [](auto& e) { return e->getHandle(); });
+        component_runners->removeEntities(removed_handles);
+        removed_entities.assign(std::make_move_iterator(std::ranges::begin(removed)), std::make_move_iterator(std::ranges::end(removed)));
         entities.erase(std::ranges::begin(removed), std::ranges::end(removed));
     }
 }
@@ -3,6 +3,10 @@ module;
 #include <chrono>
 #include <coroutine>
 #include <memory>
+#include <stop_token>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 export module lotus:core.scene;
@@ -14,27 +18,82 @@ import :util;
 namespace lotus
 {
 class Engine;
-// class Scene;
+export class Scene;
 
 // template<typename T, typename... Args>
 // concept EntityInitializer = requires(T t, Engine* engine, Scene* scene, Args... args) { { T::Init(engine, scene,
 // args...); } -> std::is_convertible_to<std::shared_ptr<Entity>> };
 
+template <typename T, typename Args> struct EntityInitTaskType;
+template <typename T, typename... Args> struct EntityInitTaskType<T, std::tuple<Args...>>
+{
+    using type = decltype(T::Init(std::declval<Engine*>(), std::declval<Scene*>(), std::declval<Args&>()...));
+};
+template <typename T, typename Args> using EntityInitTask = typename EntityInitTaskType<T, Args>::type;
+
 export class Scene
 {
 public:
     explicit Scene(Engine* _engine);
+    // ticks the scene, then steps the components' simulation (see Component::ComponentSimulateConcept)
     Task<> tick_all(time_point time, duration delta);
+    // adds and removes entities, and runs the components
+    Task<> update_all(time_point time, duration delta);
 
     template <typename T, typename... Args>
     [[nodiscard("Work must be awaited to be processed")]]
     auto AddEntity(Args... args) -> decltype(T::Init(std::declval<Engine*>(), this, args...))
     {
-        auto [sp, components] = co_await T::Init(engine, this, args...);
+        auto init = [&]
+        {
+            CancellationScope cancellation{stopToken()};
+            return T::Init(engine, this, args...);
+        }();
+        auto [sp, components] = co_await std::move(init);
         sp->setSharedPtr(sp);
         new_entities.queue(sp);
         co_return std::make_pair(sp, components);
     }
+    // spawn count entities at once, with generator(i) returning the i'th entity's T::Init arguments as a tuple
+    //  the components' init work is recorded into shared command buffers (see ComponentBatch), and the components
+    //  and entities are only published to the scene once all of them are ready
+    template <typename T, typename F>
+    [[nodiscard("Work must be awaited to be processed")]]
+    auto AddEntities(size_t count, F generator) -> Task<std::vector<std::remove_cvref_t<AwaitableReturn<EntityInitTask<T, std::invoke_result_t<F&, size_t>>>>>>
+    {
+        Component::ComponentBatch batch{engine};
+        std::vector<EntityInitTask<T, std::invoke_result_t<F&, size_t>>> tasks;
+        tasks.reserve(count);
+        {
+            Component::ComponentBatch::Scope scope{&batch};
+            CancellationScope cancellation{stopToken()};
+            for (size_t i = 0; i < count; ++i)
+            {
+                tasks.push_back(std::apply([this](auto&&... args) { return T::Init(engine, this, args...); }, generator(i)));
+            }
+        }
+        co_await batch.finish();
+
+        std::vector<std::remove_cvref_t<AwaitableReturn<EntityInitTask<T, std::invoke_result_t<F&, size_t>>>>> results;
+        results.reserve(count);
+        LockedQueue<std::shared_ptr<Entity>> entities_to_add;
+        for (auto& task : tasks)
+        {
+            auto result = co_await std::move(task);
+            result.first->setSharedPtr(result.first);
+            entities_to_add.queue(result.first);
+            results.push_back(std::move(result));
+        }
+        batch.publish();
+        new_entities.queue(entities_to_add);
+        co_return results;
+    }
+
+    // entities made here are allocated (along with their shared_ptr control block) from the scene's slab
+    std::shared_ptr<Entity> makeEntity() { return std::allocate_shared<Entity>(EntitySlabAllocator<Entity>{entity_slab}); }
+    // returns nullptr if the entity has been destroyed
+    Entity* getEntity(EntityHandle handle) const { return Entity::get(handle); }
+
     template <typename F> void forEachEntity(F func)
     {
         for (auto& entity : entities)
@@ -59,11 +118,20 @@ public:
     }
     std::unique_ptr<Component::ComponentRunners> component_runners;
 
+    // entity init work (and anything it starts, like model loads) runs under this token, and is cancelled when
+    //  the scene is replaced
+    std::stop_token stopToken() const { return stop_source.get_token(); }
+    void cancel() { stop_source.request_stop(); }
+
 protected:
     virtual Task<> tick(time_point time, duration delta) { co_return; }
 
     Engine* engine;
+    std::shared_ptr<EntitySlab> entity_slab{std::make_shared<EntitySlab>()};
     std::vector<std::shared_ptr<Entity>> entities;
-    lotus::SharedLinkedList<std::shared_ptr<Entity>> new_entities;
+    // kept alive until their components have been erased from the runners
+    std::vector<std::shared_ptr<Entity>> removed_entities;
+    LockedQueue<std::shared_ptr<Entity>> new_entities;
+    std::stop_source stop_source;
 };
 } // namespace lotus
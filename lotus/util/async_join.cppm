@@ -0,0 +1,82 @@
+module;
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+
+export module lotus:util.async_join;
+
+import :util.cancellation;
+
+namespace lotus
+{
+// Join counter for fanning out a known number of tasks
+//  each task ends with co_await join.arrive(), and a single waiter is resumed by whichever arrives last.
+//  arriving tasks stay suspended at arrive() (they are never resumed), so their owner can destroy them as soon
+//  as the waiter is resumed
+class AsyncJoin
+{
+public:
+    explicit AsyncJoin(size_t count) : remaining(count + 1) {}
+    AsyncJoin(const AsyncJoin&) = delete;
+    AsyncJoin& operator=(const AsyncJoin&) = delete;
+
+    // record an exception from one of the tasks, to be rethrown to the waiter
+    void fail(std::exception_ptr ptr)
+    {
+        if (!failed.test_and_set())
+            exception = ptr;
+    }
+
+    auto arrive() { return ArriveAwaiter{this}; }
+    auto wait() { return WaitAwaiter{this}; }
+
+    class ArriveAwaiter
+    {
+    public:
+        ArriveAwaiter(AsyncJoin* _join) : join(_join) {}
+
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept
+        {
+            if (join->remaining.fetch_sub(1, std::memory_order::acq_rel) == 1)
+                return join->waiting;
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+
+    private:
+        AsyncJoin* join;
+    };
+
+    class WaitAwaiter
+    {
+    public:
+        WaitAwaiter(AsyncJoin* _join) : join(_join) {}
+
+        bool await_ready() noexcept { return join->remaining.load(std::memory_order::acquire) == 1; }
+        bool await_suspend(std::coroutine_handle<> awaiter) noexcept
+        {
+            join->waiting = awaiter;
+            return join->remaining.fetch_sub(1, std::memory_order::acq_rel) != 1;
+        }
+        void await_resume()
+        {
+            cancellation.resume();
+            if (join->exception)
+                std::rethrow_exception(join->exception);
+        }
+
+    private:
+        AsyncJoin* join;
+        CancellationScope::Suspended cancellation;
+    };
+
+private:
+    std::atomic<size_t> remaining;
+    std::coroutine_handle<> waiting;
+    std::atomic_flag failed;
+    std::exception_ptr exception;
+};
+} // namespace lotus
@@ -6,7 +6,8 @@ module;
 
 export module lotus:util.async_queue;
 
-import :util.shared_linked_list;
+import :util.cancellation;
+import :util.locked_queue;
 
 namespace lotus
 {
@@ -26,17 +27,22 @@ public:
             awaiting = awaiter;
             queue->waiting_tasks.queue(this);
         }
-        auto await_resume() noexcept { return std::move(data); }
+        auto await_resume() noexcept
+        {
+            cancellation.resume();
+            return std::move(data);
+        }
 
         std::coroutine_handle<> awaiting;
         T data;
 
     private:
         AsyncQueue* queue;
+        CancellationScope::Suspended cancellation;
     };
 
 private:
-    SharedLinkedList<AsyncQueueItem*> waiting_tasks{};
+    LockedQueue<AsyncQueueItem*> waiting_tasks{};
 };
 
 template <> class AsyncQueue<void>
@@ -55,15 +61,16 @@ public:
             awaiting = awaiter;
             queue->waiting_tasks.queue(this);
         }
-        void await_resume() noexcept {}
+        void await_resume() noexcept { cancellation.resume(); }
 
         std::coroutine_handle<> awaiting;
 
     private:
         AsyncQueue* queue;
+        CancellationScope::Suspended cancellation;
     };
 
 private:
-    SharedLinkedList<AsyncQueueItem*> waiting_tasks{};
+    LockedQueue<AsyncQueueItem*> waiting_tasks{};
 };
 }; // namespace lotus
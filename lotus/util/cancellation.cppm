@@ -0,0 +1,56 @@
+module;
+
+#include <exception>
+#include <stop_token>
+#include <utility>
+
+export module lotus:util.cancellation;
+
+export namespace lotus
+{
+// thrown from a cancellation point once the running task's token has been cancelled, to unwind it (and release
+//  whatever it was holding) early
+class TaskCancelled : public std::exception
+{
+public:
+    const char* what() const noexcept override { return "task cancelled"; }
+};
+
+// Cancellation token of the task running on this thread
+//  like a task's priority, it's captured whenever a task is scheduled (or sleeps, or hops to the main thread) and
+//  restored when the task is resumed, so everything started from inside a scope is cancelled along with it.
+//  scheduler hops and AsyncCompute::compute are cancellation points, and anything else can check with
+//  throwIfCancelled().  tasks started outside of any scope can't be cancelled.
+//  the token follows the coroutine, not the thread: anything that resumes a coroutine inline keeps its own token in a
+//  scope, and awaiters hold a Suspended so the resumed coroutine never runs under its resumer's token
+class CancellationScope
+{
+public:
+    explicit CancellationScope(std::stop_token token) : previous(std::exchange(current_token, std::move(token))) {}
+    ~CancellationScope() { current_token = std::move(previous); }
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+    static const std::stop_token& token() { return current_token; }
+    static bool cancelled() { return current_token.stop_requested(); }
+    static void throwIfCancelled()
+    {
+        if (cancelled())
+            throw TaskCancelled{};
+    }
+
+    // the awaiting coroutine's token, captured with the awaiter and put back by resume() from await_resume
+    class Suspended
+    {
+    public:
+        void resume() const { current_token = token; }
+
+    private:
+        std::stop_token token{current_token};
+    };
+
+private:
+    static inline thread_local std::stop_token current_token;
+    std::stop_token previous;
+};
+} // namespace lotus
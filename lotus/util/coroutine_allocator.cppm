@@ -0,0 +1,225 @@
+module;
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+export module lotus:util.coroutine_allocator;
+
+export namespace lotus
+{
+// Allocator for coroutine frames (used by the promise types' operator new/delete)
+//  Frames are rounded up to a size class and recycled through thread-local free lists, so once warmed up
+//  steady-state frames don't touch the global heap.  Frames may be freed from a different thread than
+//  they were allocated on; they simply migrate to the freeing thread's list.
+//  Inside an ArenaScope, frames are instead bumped out of a thread-local arena, which is rewound as soon
+//  as every frame allocated from it has been destroyed (so only use it for work that completes within the frame)
+class CoroutineAllocator
+{
+public:
+    struct Stats
+    {
+        // frames that had to come from (or go back to) the global heap
+        uint64_t heap_allocations;
+        uint64_t heap_frees;
+        // frames that didn't fit in the arena and fell back to the free lists
+        uint64_t arena_overflows;
+    };
+
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(bool enable = true) : previous(std::exchange(arena_enabled, enable)) {}
+        ~ArenaScope() { arena_enabled = previous; }
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+    private:
+        bool previous;
+    };
+
+    static void* allocate(size_t size)
+    {
+        const size_t total = size + sizeof(Header);
+        if (arena_enabled)
+        {
+            Arena& current_arena = arena();
+            if (void* block = current_arena.allocate(total))
+            {
+                Header* header = new (block) Header{.arena = &current_arena};
+                return header + 1;
+            }
+            arena_overflows.fetch_add(1, std::memory_order::relaxed);
+        }
+        const size_t size_class = sizeClass(total);
+        void* block = nullptr;
+        if (size_class < size_class_count)
+        {
+            auto& list = free_lists().lists[size_class];
+            if (list.head)
+            {
+                block = std::exchange(list.head, list.head->next);
+                --list.count;
+            }
+            else
+            {
+                block = heapAllocate(classSize(size_class));
+            }
+        }
+        else
+        {
+            block = heapAllocate(total);
+        }
+        Header* header = new (block) Header{.arena = nullptr};
+        return header + 1;
+    }
+
+    static void deallocate(void* ptr, size_t size)
+    {
+        Header* header = static_cast<Header*>(ptr) - 1;
+        if (header->arena)
+        {
+            header->arena->live.fetch_sub(1, std::memory_order::release);
+            return;
+        }
+        const size_t size_class = sizeClass(size + sizeof(Header));
+        if (size_class < size_class_count)
+        {
+            auto& list = free_lists().lists[size_class];
+            if (list.count < max_free_list_length)
+            {
+                list.head = new (header) FreeBlock{list.head};
+                ++list.count;
+                return;
+            }
+        }
+        heapFree(header);
+    }
+
+    static Stats getStats()
+    {
+        return {.heap_allocations = heap_allocations.load(std::memory_order::relaxed),
+                .heap_frees = heap_frees.load(std::memory_order::relaxed),
+                .arena_overflows = arena_overflows.load(std::memory_order::relaxed)};
+    }
+
+private:
+    struct Arena;
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header
+    {
+        Arena* arena;
+    };
+
+    // 64 byte steps up to 1KB, then powers of two up to 16KB
+    static constexpr size_t size_class_count{20};
+    static constexpr size_t max_free_list_length{1024};
+    static constexpr size_t arena_size{1024 * 1024};
+
+    static constexpr size_t sizeClass(size_t size)
+    {
+        if (size <= 1024)
+            return (size - 1) / 64;
+        size_t size_class = 16;
+        for (size_t class_size = 2048; class_size < size; class_size *= 2)
+            ++size_class;
+        return size_class;
+    }
+
+    static constexpr size_t classSize(size_t size_class)
+    {
+        if (size_class < 16)
+            return (size_class + 1) * 64;
+        return size_t{2048} << (size_class - 16);
+    }
+
+    static void* heapAllocate(size_t size)
+    {
+        heap_allocations.fetch_add(1, std::memory_order::relaxed);
+        return ::operator new(size);
+    }
+
+    static void heapFree(void* ptr)
+    {
+        heap_frees.fetch_add(1, std::memory_order::relaxed);
+        ::operator delete(ptr);
+    }
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct FreeLists
+    {
+        struct List
+        {
+            FreeBlock* head{nullptr};
+            size_t count{0};
+        };
+        std::array<List, size_class_count> lists{};
+
+        ~FreeLists()
+        {
+            for (auto& list : lists)
+            {
+                while (list.head)
+                    heapFree(std::exchange(list.head, list.head->next));
+            }
+        }
+    };
+
+    struct Arena
+    {
+        void* allocate(size_t size)
+        {
+            // nothing allocated from the arena is still alive, so it can be rewound
+            if (live.load(std::memory_order::acquire) == 0)
+                offset = 0;
+            size = (size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+            if (offset + size > arena_size)
+                return nullptr;
+            void* block = memory.get() + offset;
+            offset += size;
+            live.fetch_add(1, std::memory_order::relaxed);
+            return block;
+        }
+
+        std::unique_ptr<std::byte[]> memory{std::make_unique_for_overwrite<std::byte[]>(arena_size)};
+        size_t offset{0};
+        std::atomic<uint32_t> live{0};
+    };
+
+    struct ArenaOwner
+    {
+        Arena* arena{new Arena};
+        ~ArenaOwner()
+        {
+            // frames from this arena may outlive the thread (only at shutdown) - leak it rather than free it under them
+            if (arena->live.load(std::memory_order::acquire) == 0)
+                delete arena;
+        }
+    };
+
+    static FreeLists& free_lists()
+    {
+        static thread_local FreeLists lists;
+        return lists;
+    }
+
+    static Arena& arena()
+    {
+        static thread_local ArenaOwner owner;
+        return *owner.arena;
+    }
+
+    static inline thread_local bool arena_enabled{false};
+
+    static inline std::atomic<uint64_t> heap_allocations{0};
+    static inline std::atomic<uint64_t> heap_frees{0};
+    static inline std::atomic<uint64_t> arena_overflows{0};
+};
+} // namespace lotus
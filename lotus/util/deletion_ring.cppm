@@ -0,0 +1,74 @@
+module;
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+export module lotus:util.deletion_ring;
+
+import :util.locked_queue;
+
+namespace lotus
+{
+template <typename T, typename... Types> constexpr bool is_vector_of{false};
+template <typename T, typename Alloc, typename... Types> constexpr bool is_vector_of<std::vector<T, Alloc>, Types...>{(std::same_as<T, Types> || ...)};
+
+// Deferred destruction of resources the GPU may still be using, one slot per frame in flight
+//  Types get their own queue each (so retiring one doesn't need to type-erase it), vectors of
+//  them are split into their elements, and anything else is held by an erased callable that only destroys it.
+//  Callbacks (which are called when the frame is flushed) go through callback() instead, so that a resource that
+//  happens to be invocable is never called.
+//  Everything retired between two beginFrame() calls belongs to the later frame, and is destroyed in one pass
+//  by flush() once that frame has completed on the GPU
+template <typename... Types> class DeletionRing
+{
+public:
+    using Callable = std::move_only_function<void()>;
+
+    void resize(size_t frame_count) { frames.resize(frame_count); }
+
+    // rvalues only, so that retiring a vector can't quietly empty the caller's
+    template <typename T>
+        requires(!std::is_lvalue_reference_v<T>)
+    void retire(T&& resource)
+    {
+        using Resource = std::remove_cvref_t<T>;
+        if constexpr ((std::same_as<Resource, Types> || ...))
+        {
+            std::get<LockedQueue<Resource>>(pending).queue(std::forward<T>(resource));
+        }
+        else if constexpr (is_vector_of<Resource, Types...>)
+        {
+            auto& queue = std::get<LockedQueue<typename Resource::value_type>>(pending);
+            for (auto& element : resource)
+                queue.queue(std::move(element));
+        }
+        else
+        {
+            std::get<LockedQueue<Callable>>(pending).queue(Callable{[held = std::move(resource)]() {}});
+        }
+    }
+
+    template <std::invocable F> void callback(F&& func) { std::get<LockedQueue<Callable>>(pending).queue(Callable{std::forward<F>(func)}); }
+
+    // hand everything retired since the last call to frame
+    void beginFrame(size_t frame) { frames[frame] = std::move(pending); }
+
+    // frame has completed on the GPU - destroy everything it was holding on to
+    void flush(size_t frame)
+    {
+        for (auto& callable : std::get<LockedQueue<Callable>>(frames[frame]).drain())
+            callable();
+        frames[frame] = Queues{};
+    }
+
+private:
+    using Queues = std::tuple<LockedQueue<Types>..., LockedQueue<Callable>>;
+    Queues pending;
+    std::vector<Queues> frames;
+};
+} // namespace lotus
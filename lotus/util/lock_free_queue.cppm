@@ -0,0 +1,257 @@
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+export module lotus:util.lock_free_queue;
+
+export namespace lotus
+{
+// Lock-free multi-producer multi-consumer queue
+//  queue() links a node onto an intrusive list with a single CAS, and drain()/getAll() take the whole list with
+//  a single exchange (then walk it oldest first).  get() pops one item, most recently queued first, so it's meant
+//  for unordered uses like free lists.
+//  Nodes are recycled through a pool shared by every queue of the same type, and are never returned to the heap
+//  (which is also what makes it safe for get() to read a node another thread has just popped)
+template <typename T> class LockFreeQueue
+{
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        alignas(T) std::byte storage[sizeof(T)];
+        T& value() { return *std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+public:
+    LockFreeQueue() = default;
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+    LockFreeQueue(LockFreeQueue&& o) noexcept { head.store(pack(o.takeAll(), 0), std::memory_order::relaxed); }
+    LockFreeQueue& operator=(LockFreeQueue&& o) noexcept
+    {
+        if (this != &o)
+        {
+            auto* nodes = o.takeAll();
+            auto current = head.load(std::memory_order::relaxed);
+            while (!head.compare_exchange_weak(current, pack(nodes, current), std::memory_order::acq_rel, std::memory_order::relaxed))
+                ;
+            destroy(pointer(current));
+        }
+        return *this;
+    }
+    ~LockFreeQueue() { destroy(takeAll()); }
+
+    // the returned reference stays valid until the item is taken out of the queue
+    T& queue(T val)
+    {
+        auto* node = NodePool::allocate();
+        auto* value = new (node->storage) T(std::move(val));
+        pushNodes(node, node);
+        return *value;
+    }
+
+    // move every item from o onto the end of this queue
+    void queue(LockFreeQueue& o)
+    {
+        if (auto* first = o.takeAll())
+        {
+            auto* last = first;
+            while (auto* next = last->next.load(std::memory_order::relaxed))
+                last = next;
+            pushNodes(first, last);
+        }
+    }
+
+    std::optional<T> get()
+    {
+        auto current = head.load(std::memory_order::acquire);
+        while (auto* node = pointer(current))
+        {
+            if (head.compare_exchange_weak(current, pack(node->next.load(std::memory_order::relaxed), current), std::memory_order::acquire,
+                                           std::memory_order::acquire))
+            {
+                std::optional<T> value{std::move(node->value())};
+                node->value().~T();
+                NodePool::recycle(node, node);
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // items taken out of a queue by drain(), oldest first - destroyed (and their nodes recycled) along with the Drained
+    class Drained
+    {
+    public:
+        Drained(const Drained&) = delete;
+        Drained& operator=(const Drained&) = delete;
+        Drained(Drained&& o) noexcept : first(std::exchange(o.first, nullptr)), last(std::exchange(o.last, nullptr)), count(std::exchange(o.count, 0)) {}
+        Drained& operator=(Drained&&) = delete;
+        ~Drained()
+        {
+            for (auto& value : *this)
+                value.~T();
+            if (first)
+                NodePool::recycle(first, last);
+        }
+
+        class iterator
+        {
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            explicit iterator(Node* _node) : node(_node) {}
+            T& operator*() const { return node->value(); }
+            T* operator->() const { return &node->value(); }
+            iterator& operator++()
+            {
+                node = node->next.load(std::memory_order::relaxed);
+                return *this;
+            }
+            iterator operator++(int)
+            {
+                auto previous = *this;
+                ++*this;
+                return previous;
+            }
+            bool operator==(const iterator&) const = default;
+
+        private:
+            Node* node{nullptr};
+        };
+
+        iterator begin() const { return iterator{first}; }
+        iterator end() const { return iterator{}; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+    private:
+        friend class LockFreeQueue;
+        // nodes come off the queue newest first, so reverse them
+        explicit Drained(Node* newest) : last(newest)
+        {
+            while (newest)
+            {
+                auto* next = newest->next.load(std::memory_order::relaxed);
+                newest->next.store(first, std::memory_order::relaxed);
+                first = std::exchange(newest, next);
+                ++count;
+            }
+        }
+
+        Node* first{nullptr};
+        Node* last{nullptr};
+        size_t count{0};
+    };
+
+    // take everything currently in the queue
+    Drained drain() { return Drained{takeAll()}; }
+
+    std::vector<T> getAll()
+    {
+        auto drained = drain();
+        std::vector<T> values;
+        values.reserve(drained.size());
+        std::ranges::move(drained, std::back_inserter(values));
+        return values;
+    }
+
+private:
+    // free nodes are shared between threads through a list that is only ever pushed to or taken whole (so it has no
+    //  ABA problem), and each thread takes the whole list into its own cache when it runs out
+    class NodePool
+    {
+    public:
+        static Node* allocate()
+        {
+            auto& cache = localCache();
+            if (!cache.head)
+                cache.head = freeNodes().exchange(nullptr, std::memory_order::acquire);
+            if (!cache.head)
+                return new Node;
+            return std::exchange(cache.head, cache.head->next.load(std::memory_order::relaxed));
+        }
+
+        // return a linked run of nodes
+        static void recycle(Node* first, Node* last)
+        {
+            auto& free_nodes = freeNodes();
+            auto current = free_nodes.load(std::memory_order::relaxed);
+            do
+            {
+                last->next.store(current, std::memory_order::relaxed);
+            } while (!free_nodes.compare_exchange_weak(current, first, std::memory_order::release, std::memory_order::relaxed));
+        }
+
+    private:
+        struct Cache
+        {
+            Node* head{nullptr};
+            ~Cache()
+            {
+                if (head)
+                {
+                    auto* last = head;
+                    while (auto* next = last->next.load(std::memory_order::relaxed))
+                        last = next;
+                    recycle(head, last);
+                }
+            }
+        };
+
+        static Cache& localCache()
+        {
+            static thread_local Cache cache;
+            return cache;
+        }
+
+        static std::atomic<Node*>& freeNodes()
+        {
+            static std::atomic<Node*> free_nodes{nullptr};
+            return free_nodes;
+        }
+    };
+
+    // head is the newest node, with a modification count in the top 16 bits so that a get() can't succeed on a
+    //  node that was popped and queued again while it was looking at it
+    static_assert(sizeof(uintptr_t) == 8, "LockFreeQueue tags the upper bits of 64-bit pointers");
+    static constexpr int tag_shift{48};
+    static constexpr uintptr_t pointer_mask{(uintptr_t{1} << tag_shift) - 1};
+
+    static Node* pointer(uintptr_t value) { return reinterpret_cast<Node*>(value & pointer_mask); }
+    static uintptr_t pack(Node* node, uintptr_t previous)
+    {
+        return reinterpret_cast<uintptr_t>(node) | ((previous & ~pointer_mask) + (uintptr_t{1} << tag_shift));
+    }
+
+    void pushNodes(Node* first, Node* last)
+    {
+        auto current = head.load(std::memory_order::relaxed);
+        do
+        {
+            last->next.store(pointer(current), std::memory_order::relaxed);
+        } while (!head.compare_exchange_weak(current, pack(first, current), std::memory_order::release, std::memory_order::relaxed));
+    }
+
+    Node* takeAll()
+    {
+        auto current = head.load(std::memory_order::relaxed);
+        while (pointer(current) && !head.compare_exchange_weak(current, pack(nullptr, current), std::memory_order::acquire, std::memory_order::relaxed))
+            ;
+        return pointer(current);
+    }
+
+    static void destroy(Node* nodes) { Drained drained{nodes}; }
+
+    std::atomic<uintptr_t> head{0};
+};
+} // namespace lotus
@@ -0,0 +1,88 @@
+module;
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+export module lotus:util.locked_queue;
+
+export namespace lotus
+{
+// Mutex-guarded multi-producer multi-consumer queue, with the same interface as LockedQueue
+//  this is what the engine's queues use until LockedQueue is shown to be faster under real contention (run
+//  benchmarks/lock_free_queue.cpp on a multi-core machine).  get() pops the most recently queued item, like
+//  LockedQueue's, and drain() hands back the whole queue oldest first
+template <typename T> class LockedQueue
+{
+public:
+    LockedQueue() = default;
+    LockedQueue(const LockedQueue&) = delete;
+    LockedQueue& operator=(const LockedQueue&) = delete;
+    LockedQueue(LockedQueue&& o) : items(o.takeAll()) {}
+    LockedQueue& operator=(LockedQueue&& o)
+    {
+        if (this != &o)
+        {
+            auto taken = o.takeAll();
+            std::lock_guard lk{mutex};
+            std::swap(items, taken);
+        }
+        return *this;
+    }
+
+    // the returned reference stays valid until the item is taken out of the queue (a deque never moves its items)
+    T& queue(T val)
+    {
+        std::lock_guard lk{mutex};
+        return items.emplace_back(std::move(val));
+    }
+
+    // move every item from o onto the end of this queue
+    void queue(LockedQueue& o)
+    {
+        auto taken = o.takeAll();
+        if (taken.empty())
+            return;
+        std::lock_guard lk{mutex};
+        if (items.empty())
+            std::swap(items, taken);
+        else
+            std::ranges::move(taken, std::back_inserter(items));
+    }
+
+    std::optional<T> get()
+    {
+        std::lock_guard lk{mutex};
+        if (items.empty())
+            return std::nullopt;
+        std::optional<T> value{std::move(items.back())};
+        items.pop_back();
+        return value;
+    }
+
+    // take everything currently in the queue
+    std::deque<T> drain() { return takeAll(); }
+
+    std::vector<T> getAll()
+    {
+        auto taken = takeAll();
+        return std::vector<T>(std::make_move_iterator(taken.begin()), std::make_move_iterator(taken.end()));
+    }
+
+private:
+    std::deque<T> takeAll()
+    {
+        std::deque<T> taken;
+        std::lock_guard lk{mutex};
+        std::swap(items, taken);
+        return taken;
+    }
+
+    std::mutex mutex;
+    std::deque<T> items;
+};
+} // namespace lotus
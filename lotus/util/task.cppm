@@ -2,12 +2,16 @@ module;
 
 #include <atomic>
 #include <coroutine>
+#include <cstddef>
 #include <exception>
 #include <iostream>
 #include <utility>
 
 export module lotus:util.task;
 
+import :util.cancellation;
+import :util.coroutine_allocator;
+
 namespace lotus
 {
 // this works when co_await returns the awaiter, but may need something for any other case
@@ -39,6 +43,9 @@ export template <typename Result> struct Task;
 
 struct Promise_base
 {
+    static void* operator new(std::size_t size) { return CoroutineAllocator::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) { CoroutineAllocator::deallocate(ptr, size); }
+
     auto initial_suspend() noexcept { return std::suspend_never{}; }
 
     struct final_awaitable
@@ -56,6 +63,18 @@ struct Promise_base
     void unhandled_exception()
     {
         exception = std::current_exception();
+        try
+        {
+            throw;
+        }
+        catch (const TaskCancelled&)
+        {
+            // unwinding on purpose
+            return;
+        }
+        catch (...)
+        {
+        }
         std::cout << "Exception thrown in task" << std::endl;
     }
 
@@ -139,8 +158,13 @@ export template <typename Result = void> struct [[nodiscard]] Task
             awaitable(std::coroutine_handle<promise_type> _handle) : handle(_handle) {}
             auto await_ready() const noexcept { return !handle || handle.done(); }
             auto await_suspend(std::coroutine_handle<> awaiting) noexcept { return handle.promise().next_handle.exchange(awaiting) != nullptr; }
-            auto await_resume() { return handle.promise().result(); }
+            auto await_resume()
+            {
+                cancellation.resume();
+                return handle.promise().result();
+            }
             std::coroutine_handle<promise_type> handle;
+            CancellationScope::Suspended cancellation;
         };
         return awaitable{handle};
     }
@@ -152,8 +176,13 @@ export template <typename Result = void> struct [[nodiscard]] Task
             awaitable(std::coroutine_handle<promise_type> _handle) : handle(_handle) {}
             auto await_ready() const noexcept { return !handle || handle.done(); }
             auto await_suspend(std::coroutine_handle<> awaiting) noexcept { return handle.promise().next_handle.exchange(awaiting) != nullptr; }
-            auto await_resume() { return std::move(handle.promise()).result(); }
+            auto await_resume()
+            {
+                cancellation.resume();
+                return std::move(handle.promise()).result();
+            }
             std::coroutine_handle<promise_type> handle;
+            CancellationScope::Suspended cancellation;
         };
         return awaitable{handle};
     }
@@ -0,0 +1,162 @@
+module;
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+export module lotus:util.timer_wheel;
+
+import :util.types;
+
+namespace lotus
+{
+// Hierarchical timer wheel
+//  each level has 64 slots, and one slot spans a whole turn of the level below it (1ms, 64ms, ~4s, ~4.5min,
+//  ~4.8h).  a timer goes into the level of the highest tick digit it doesn't share with the current tick, and
+//  moves down a level each time its slot comes around, so inserting and expiring are O(1) no matter how many
+//  timers are armed.  timers are intrusive (arming one never allocates), and the wheel itself is only ever
+//  touched by the thread that advances it
+class TimerWheel
+{
+public:
+    struct Timer
+    {
+        time_point deadline;
+        Timer* next{nullptr};
+    };
+
+    explicit TimerWheel(time_point _start) : start(_start) {}
+
+    // anything already due fires on the next tick
+    void insert(Timer* timer) { place(timer, std::max(ticksUntil(timer->deadline), current_tick + 1)); }
+
+    // move the wheel forward to now, calling on_expired(Timer*) for each timer that expires along the way
+    template <typename F> void advance(time_point now, F&& on_expired)
+    {
+        const auto target = static_cast<uint64_t>((now - start) / resolution);
+        while (current_tick < target)
+        {
+            // nothing happens on the ticks in between, so skip straight to the next one that does something
+            const auto next = nextTick();
+            if (!next || *next > target)
+            {
+                current_tick = target;
+                break;
+            }
+            current_tick = *next;
+            if ((current_tick & (max_ticks - 1)) == 0)
+                reinsert(std::exchange(overflow, nullptr));
+            // cascade from the top down, so a timer that moves down a level can cascade again on the same tick
+            for (size_t level = levels - 1; level > 0; --level)
+            {
+                if ((current_tick & ((uint64_t{1} << (slot_bits * level)) - 1)) == 0)
+                    reinsert(take(level, slotOf(current_tick, level)));
+            }
+            for (auto* timer = take(0, slotOf(current_tick, 0)); timer;)
+                on_expired(std::exchange(timer, timer->next));
+        }
+    }
+
+    // when the wheel next needs advancing (the earliest expiry or cascade), or nullopt if no timers are armed
+    std::optional<time_point> nextExpiry() const
+    {
+        if (auto next = nextTick())
+            return start + resolution * *next;
+        return std::nullopt;
+    }
+
+    bool empty() const
+    {
+        if (overflow)
+            return false;
+        for (auto mask : occupied)
+        {
+            if (mask)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr std::chrono::milliseconds resolution{1};
+    static constexpr size_t slot_bits{6};
+    static constexpr size_t slot_count{size_t{1} << slot_bits};
+    static constexpr size_t levels{5};
+    static constexpr uint64_t max_ticks{uint64_t{1} << (slot_bits * levels)};
+
+    static size_t slotOf(uint64_t tick, size_t level) { return (tick >> (slot_bits * level)) & (slot_count - 1); }
+
+    std::optional<uint64_t> nextTick() const
+    {
+        std::optional<uint64_t> next;
+        if (overflow)
+            next = ((current_tick / max_ticks) + 1) * max_ticks;
+        for (size_t level = 0; level < levels; ++level)
+        {
+            if (!occupied[level])
+                continue;
+            const auto shift = slot_bits * level;
+            const auto position = slotOf(current_tick, level);
+            // slots after the current position this turn, then the ones before it (and the current one) next turn
+            const auto ahead = std::rotr(occupied[level], static_cast<int>(position + 1));
+            const auto distance = static_cast<uint64_t>(std::countr_zero(ahead)) + 1;
+            const auto tick = ((current_tick >> shift) + distance) << shift;
+            if (!next || tick < *next)
+                next = tick;
+        }
+        return next;
+    }
+
+    // rounded up, so that a timer never fires before its deadline
+    uint64_t ticksUntil(time_point deadline) const
+    {
+        if (deadline <= start)
+            return 0;
+        return static_cast<uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(deadline - start) / resolution);
+    }
+
+    void place(Timer* timer, uint64_t tick)
+    {
+        const auto level = tick == current_tick ? 0 : static_cast<size_t>(std::bit_width(tick ^ current_tick) - 1) / slot_bits;
+        if (level >= levels)
+        {
+            // beyond the top level's turn - looked at again when it wraps
+            timer->next = overflow;
+            overflow = timer;
+            return;
+        }
+        const auto slot = slotOf(tick, level);
+        timer->next = slots[level][slot];
+        slots[level][slot] = timer;
+        occupied[level] |= uint64_t{1} << slot;
+    }
+
+    // timers cascading down on this tick may be due on it, and will expire before advance() moves on
+    void reinsert(Timer* timers)
+    {
+        while (timers)
+        {
+            auto* timer = std::exchange(timers, timers->next);
+            place(timer, std::max(ticksUntil(timer->deadline), current_tick));
+        }
+    }
+
+    Timer* take(size_t level, size_t slot)
+    {
+        occupied[level] &= ~(uint64_t{1} << slot);
+        auto* timers = slots[level][slot];
+        slots[level][slot] = nullptr;
+        return timers;
+    }
+
+    time_point start;
+    uint64_t current_tick{0};
+    std::array<std::array<Timer*, slot_count>, levels> slots{};
+    std::array<uint64_t, levels> occupied{};
+    Timer* overflow{nullptr};
+};
+} // namespace lotus
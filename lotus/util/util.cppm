@@ -1,10 +1,17 @@
 export module lotus:util;
 
+export import :util.async_join;
 export import :util.async_queue;
+export import :util.cancellation;
+export import :util.coroutine_allocator;
+export import :util.deletion_ring;
 export import :util.id_generator;
+export import :util.lock_free_queue;
+export import :util.locked_queue;
 export import :util.random;
-export import :util.shared_linked_list;
 export import :util.task;
+export import :util.timer_wheel;
 export import :util.types;
+export import :util.work_stealing_deque;
 export import :util.worker_pool;
 export import :util.worker_task;
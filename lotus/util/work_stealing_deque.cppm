@@ -0,0 +1,114 @@
+module;
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+export module lotus:util.work_stealing_deque;
+
+namespace lotus
+{
+// Chase-Lev work stealing deque (Le et al, "Correct and Efficient Work-Stealing for Weak Memory Models")
+//  push/pop may only be called by the owning thread, steal may be called from any thread
+//  empty results are returned as nullptr, so only pointer types are supported
+template <typename T>
+    requires std::is_pointer_v<T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+    {
+        auto initial = std::make_unique<Array>(capacity);
+        array.store(initial.get(), std::memory_order::relaxed);
+        arrays.push_back(std::move(initial));
+    }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    void push(T item)
+    {
+        int64_t b = bottom.load(std::memory_order::relaxed);
+        int64_t t = top.load(std::memory_order::acquire);
+        Array* a = array.load(std::memory_order::relaxed);
+        if (b - t > a->capacity - 1)
+        {
+            a = grow(a, t, b);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order::release);
+        bottom.store(b + 1, std::memory_order::relaxed);
+    }
+
+    T pop()
+    {
+        int64_t b = bottom.load(std::memory_order::relaxed) - 1;
+        Array* a = array.load(std::memory_order::relaxed);
+        bottom.store(b, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        int64_t t = top.load(std::memory_order::relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order::relaxed);
+            return nullptr;
+        }
+        T item = a->get(b);
+        if (t == b)
+        {
+            // last item, race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed))
+                item = nullptr;
+            bottom.store(b + 1, std::memory_order::relaxed);
+        }
+        return item;
+    }
+
+    T steal()
+    {
+        int64_t t = top.load(std::memory_order::acquire);
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        int64_t b = bottom.load(std::memory_order::acquire);
+        if (t >= b)
+            return nullptr;
+        Array* a = array.load(std::memory_order::acquire);
+        T item = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed))
+            return nullptr;
+        return item;
+    }
+
+    bool empty() const { return bottom.load(std::memory_order::relaxed) <= top.load(std::memory_order::relaxed); }
+
+private:
+    struct Array
+    {
+        explicit Array(int64_t _capacity) : capacity(_capacity), mask(_capacity - 1), buffer(std::make_unique<std::atomic<T>[]>(_capacity)) {}
+        T get(int64_t i) const { return buffer[i & mask].load(std::memory_order::relaxed); }
+        void put(int64_t i, T item) { buffer[i & mask].store(item, std::memory_order::relaxed); }
+
+        const int64_t capacity;
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> buffer;
+    };
+
+    Array* grow(Array* old, int64_t t, int64_t b)
+    {
+        auto new_array = std::make_unique<Array>(old->capacity * 2);
+        for (int64_t i = t; i < b; ++i)
+        {
+            new_array->put(i, old->get(i));
+        }
+        auto* a = new_array.get();
+        // thieves may still be reading from the old array, so it is kept alive until the deque is destroyed
+        arrays.push_back(std::move(new_array));
+        array.store(a, std::memory_order::release);
+        return a;
+    }
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> arrays;
+};
+} // namespace lotus
@@ -1,51 +1,178 @@
 module;
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
 #include <cstdint>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stop_token>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
 module lotus;
 
 import :util.worker_pool;
 
+import :core.config;
 import :core.engine;
 import :renderer.vulkan.renderer;
 import vulkan_hpp;
 
 namespace lotus
 {
+namespace
+{
+struct LogicalCpu
+{
+    uint32_t id;
+    // 0 for the first hardware thread of a physical core, 1+ for its SMT siblings
+    uint32_t sibling;
+};
 
-WorkerPool::WorkerPool(Engine* _engine) : engine(_engine)
+// logical CPUs with their position on their physical core (if the platform can tell us)
+std::vector<LogicalCpu> queryCpus()
+{
+    std::vector<LogicalCpu> cpus;
+#if defined(_WIN32)
+    // only the calling thread's processor group (64 logical CPUs)
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+    std::vector<std::byte> buffer(length);
+    auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+    if (GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+    {
+        for (DWORD offset = 0; offset < length; offset += info->Size)
+        {
+            info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+            uint32_t sibling = 0;
+            for (uint32_t bit = 0; bit < 64; ++bit)
+            {
+                if (info->Processor.GroupMask[0].Mask & (KAFFINITY{1} << bit))
+                    cpus.push_back({bit, sibling++});
+            }
+        }
+    }
+#elif defined(__linux__)
+    std::map<std::pair<int, int>, uint32_t> cores;
+    for (uint32_t cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+    {
+        int package = -1, core = -1;
+        std::ifstream{std::format("/sys/devices/system/cpu/cpu{}/topology/physical_package_id", cpu)} >> package;
+        std::ifstream{std::format("/sys/devices/system/cpu/cpu{}/topology/core_id", cpu)} >> core;
+        if (core < 0)
+        {
+            cpus.clear();
+            break;
+        }
+        cpus.push_back({cpu, cores[{package, core}]++});
+    }
+#endif
+    if (cpus.empty())
+    {
+        for (uint32_t cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+            cpus.push_back({cpu, 0});
+    }
+    return cpus;
+}
+
+void pinCurrentThread(uint32_t cpu)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), KAFFINITY{1} << cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+} // namespace
+
+WorkerPool::WorkerPool(Engine* _engine) : engine(_engine), spin_duration(std::chrono::microseconds{engine->config->workers.spin_microseconds})
 {
     temp_pool = this;
-    worker_flag.test_and_set();
-    finished_tasks.resize(engine->renderer->getFrameCount());
-    for (size_t i = 0; i < std::thread::hardware_concurrency(); ++i)
+    deletion_ring.resize(engine->renderer->getFrameCount());
+
+    const auto& config = engine->config->workers;
+    auto cpus = queryCpus();
+    if (config.smt_aware)
+        std::ranges::stable_sort(cpus, {}, &LogicalCpu::sibling);
+    const auto physical_cores = static_cast<size_t>(std::ranges::count(cpus, 0u, &LogicalCpu::sibling));
+    // the first CPU in placement order is left to the main thread
+    size_t thread_count = config.thread_count;
+    if (thread_count == 0)
+        thread_count = std::max<size_t>(1, (config.smt_aware ? physical_cores : cpus.size()) - 1);
+
+    for (size_t i = 0; i < thread_count; ++i)
     {
+        workers.push_back(std::make_unique<Worker>(this, static_cast<uint32_t>(i) * 0x9E3779B9u | 1u));
+    }
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        std::optional<uint32_t> cpu;
+        if (config.pin_threads)
+            cpu = cpus[(i + 1) % cpus.size()].id;
         threads.emplace_back(
-            [this](std::stop_token stop)
+            [this, &worker = *workers[i], cpu](std::stop_token stop)
             {
+                if (cpu)
+                    pinCurrentThread(*cpu);
                 auto thread_locals = engine->renderer->createThreadLocals();
-                runTasks(stop);
+                current_worker = &worker;
+                runTasks(stop, worker);
+                current_worker = nullptr;
             });
     }
+    timer_thread = std::jthread{[this](std::stop_token stop) { runTimers(stop); }};
 }
 
 void WorkerPool::Run()
 {
     auto thread_locals = engine->renderer->createThreadLocals();
+    // the main thread only drives the frame loop, so anything it schedules is frame-critical
+    current_priority = Priority::Critical;
     while (!threads[0].get_stop_token().stop_requested())
     {
-        main_flag.clear();
-        main_flag.notify_one();
-        main_flag.wait(false);
-        if (!threads[0].get_stop_token().stop_requested())
+        pending_main_tasks.wait(0, std::memory_order::acquire);
+        // tasks queued while this batch runs (including by the tasks in it) go into the next one
+        for (auto* task : main_tasks.drain())
         {
-            auto task = std::exchange(main_task, nullptr);
-            task->awaiting.resume();
+            pending_main_tasks.fetch_sub(1, std::memory_order::relaxed);
+            if (!threads[0].get_stop_token().stop_requested())
+            {
+                CancellationScope scope{std::move(task->stop_token)};
+                task->awaiting.resume();
+            }
         }
     }
     if (exception)
@@ -58,11 +185,11 @@ void WorkerPool::Stop()
     {
         thread.request_stop();
     }
-    main_flag.test_and_set();
-    main_flag.notify_one();
-    ScheduledTask t(this);
-    task_head.store(&t);
-    task_head.notify_all();
+    timer_thread.request_stop();
+    pending_main_tasks.fetch_add(1);
+    pending_main_tasks.notify_one();
+    pending_tasks.fetch_add(1);
+    pending_tasks.notify_all();
 }
 
 void WorkerPool::Stop(std::exception_ptr ptr)
@@ -71,41 +198,206 @@ void WorkerPool::Stop(std::exception_ptr ptr)
     Stop();
 }
 
-void WorkerPool::runTasks(std::stop_token stop)
+void WorkerPool::runTasks(std::stop_token stop, Worker& worker)
 {
-    task_head.wait(nullptr);
     while (!stop.stop_requested())
     {
-        if (!worker_flag.test_and_set())
+        if (auto* task = tryGetTask(worker))
         {
-            main_flag.wait(true);
+            pending_tasks.fetch_sub(1, std::memory_order::relaxed);
+            worker.tasks_run.fetch_add(1, std::memory_order::relaxed);
+            current_priority = task->priority;
+            CancellationScope scope{std::move(task->stop_token)};
+            task->awaiting.resume();
         }
-        if (!stop.stop_requested())
+        else
         {
-            auto* task = tryGetTask();
-            if (task)
-                task->awaiting.resume();
-            task_head.wait(nullptr);
+            waitForTask(worker);
         }
     }
 }
 
-WorkerPool::ScheduledTask* WorkerPool::tryGetTask()
+void WorkerPool::waitForTask(Worker& worker)
 {
-    auto head = task_head.load();
-    while (head && !task_head.compare_exchange_weak(head, head->next, std::memory_order::seq_cst, std::memory_order::relaxed))
-        ;
+    // a task may be queued but not yet visible to this worker, so only wait if there's nothing pending at all
+    if (pending_tasks.load(std::memory_order::relaxed) != 0)
+        return;
+
+    // spin for a little while first - new work usually shows up within a few microseconds mid-frame, and that's
+    //  much cheaper than a futex wake
+    const auto spin_start = std::chrono::steady_clock::now();
+    auto now = spin_start;
+    uint32_t backoff = 1;
+    while (pending_tasks.load(std::memory_order::relaxed) == 0 && now - spin_start < spin_duration)
+    {
+        for (uint32_t i = 0; i < backoff; ++i)
+            cpuRelax();
+        backoff = std::min(backoff * 2, max_spin_backoff);
+        now = std::chrono::steady_clock::now();
+    }
+    worker.spin_ns.fetch_add((now - spin_start).count(), std::memory_order::relaxed);
+    if (pending_tasks.load(std::memory_order::relaxed) != 0)
+    {
+        worker.spin_hits.fetch_add(1, std::memory_order::relaxed);
+        return;
+    }
 
-    return head;
+    worker.parks.fetch_add(1, std::memory_order::relaxed);
+    pending_tasks.wait(0);
+    worker.park_ns.fetch_add((std::chrono::steady_clock::now() - now).count(), std::memory_order::relaxed);
+}
+
+WorkerPool::Metrics WorkerPool::getMetrics() const
+{
+    Metrics metrics;
+    for (const auto& worker : workers)
+    {
+        metrics.tasks_run += worker->tasks_run.load(std::memory_order::relaxed);
+        metrics.tasks_stolen += worker->tasks_stolen.load(std::memory_order::relaxed);
+        metrics.spin_hits += worker->spin_hits.load(std::memory_order::relaxed);
+        metrics.parks += worker->parks.load(std::memory_order::relaxed);
+        metrics.spin_time += std::chrono::nanoseconds{worker->spin_ns.load(std::memory_order::relaxed)};
+        metrics.park_time += std::chrono::nanoseconds{worker->park_ns.load(std::memory_order::relaxed)};
+    }
+    return metrics;
+}
+
+WorkerPool::ScheduledTask* WorkerPool::tryGetTask(Worker& worker)
+{
+    ++worker.pop_count;
+    if (worker.pop_count % starvation_interval == 0)
+    {
+        for (size_t lane = priority_count; lane > 0; --lane)
+        {
+            if (auto* task = tryGetTask(worker, static_cast<Priority>(lane - 1)))
+                return task;
+        }
+    }
+    for (size_t lane = 0; lane < priority_count; ++lane)
+    {
+        if (auto* task = tryGetTask(worker, static_cast<Priority>(lane)))
+            return task;
+    }
+    return nullptr;
+}
+
+WorkerPool::ScheduledTask* WorkerPool::tryGetTask(Worker& worker, Priority priority)
+{
+    if (worker.pop_count % injection_interval == 0)
+    {
+        if (auto* task = tryGetInjectedTask(priority))
+            return task;
+    }
+    if (auto* task = worker.tasks[static_cast<size_t>(priority)].pop())
+        return task;
+    if (auto* task = tryGetInjectedTask(priority))
+        return task;
+    return stealTask(worker, priority);
+}
+
+WorkerPool::ScheduledTask* WorkerPool::stealTask(Worker& worker, Priority priority)
+{
+    // xorshift32 to pick a random victim to start from
+    worker.rng_state ^= worker.rng_state << 13;
+    worker.rng_state ^= worker.rng_state >> 17;
+    worker.rng_state ^= worker.rng_state << 5;
+    const size_t start = worker.rng_state % workers.size();
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        auto& victim = *workers[(start + i) % workers.size()];
+        if (&victim == &worker)
+            continue;
+        if (auto* task = victim.tasks[static_cast<size_t>(priority)].steal())
+        {
+            worker.tasks_stolen.fetch_add(1, std::memory_order::relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+WorkerPool::ScheduledTask* WorkerPool::tryGetInjectedTask(Priority priority)
+{
+    auto& queue = injection_queues[static_cast<size_t>(priority)];
+    // a task injected just after this check is still counted in pending_tasks, so the worker won't park on it
+    if (queue.size.load(std::memory_order::relaxed) == 0)
+        return nullptr;
+    std::lock_guard lk{queue.mutex};
+    auto* task = queue.head;
+    if (task)
+    {
+        queue.head = task->next;
+        if (!queue.head)
+            queue.tail = nullptr;
+        task->next = nullptr;
+        queue.size.fetch_sub(1, std::memory_order::relaxed);
+    }
+    return task;
+}
+
+void WorkerPool::injectTask(ScheduledTask* task)
+{
+    auto& queue = injection_queues[static_cast<size_t>(task->priority)];
+    std::lock_guard lk{queue.mutex};
+    task->next = nullptr;
+    if (queue.tail)
+        queue.tail->next = task;
+    else
+        queue.head = task;
+    queue.tail = task;
+    queue.size.fetch_add(1, std::memory_order::relaxed);
 }
 
 void WorkerPool::queueTask(ScheduledTask* task)
 {
-    task->next = task_head.load(std::memory_order::relaxed);
-    while (!task_head.compare_exchange_weak(task->next, task, std::memory_order::seq_cst, std::memory_order::relaxed))
-        ;
+    pending_tasks.fetch_add(1, std::memory_order::relaxed);
+    if (current_worker && current_worker->pool == this)
+        current_worker->tasks[static_cast<size_t>(task->priority)].push(task);
+    else
+        injectTask(task);
+    pending_tasks.notify_one();
+}
+
+void WorkerPool::queueMainTask(MainThreadTask* task)
+{
+    main_tasks.queue(task);
+    pending_main_tasks.fetch_add(1, std::memory_order::release);
+    pending_main_tasks.notify_one();
+}
+
+void WorkerPool::queueTimer(SleepTask* timer, std::coroutine_handle<> awaiter)
+{
+    timer->task.awaiting = awaiter;
+    // the timer can fire (and be destroyed) as soon as it's queued
+    const auto deadline = timer->deadline;
+    new_timers.queue(timer);
+    timers_queued.store(true);
+    if (deadline < next_timer_wakeup.load())
+    {
+        std::lock_guard lk{timer_mutex};
+        timer_cv.notify_one();
+    }
+}
 
-    task_head.notify_one();
+void WorkerPool::runTimers(std::stop_token stop)
+{
+    TimerWheel wheel{sim_clock::now()};
+    while (!stop.stop_requested())
+    {
+        timers_queued.store(false);
+        for (auto* timer : new_timers.drain())
+            wheel.insert(timer);
+        wheel.advance(sim_clock::now(), [](TimerWheel::Timer* timer) { static_cast<SleepTask*>(timer)->task.queueTask(); });
+
+        std::unique_lock lk{timer_mutex};
+        const auto next = wheel.nextExpiry();
+        // published before checking timers_queued, so a timer queued after the check always sees it
+        next_timer_wakeup.store(next.value_or(time_point::max()));
+        if (next)
+            timer_cv.wait_until(lk, stop, *next, [this] { return timers_queued.load(); });
+        else
+            timer_cv.wait(lk, stop, [this] { return timers_queued.load(); });
+    }
 }
 
 std::vector<vk::CommandBuffer> WorkerPool::getPrimaryGraphicsBuffers(int) { return command_buffers.graphics_primary.getAll(); }
@@ -117,15 +409,19 @@ void WorkerPool::processFrameWaits()
 {
     for (auto& task : frame_waiting_queue.getAll())
     {
+        // the waiter switches to its own token, and the caller's (the engine's) comes back when it suspends
+        CancellationScope scope{CancellationScope::token()};
         task->awaiting.resume();
     }
 }
 
-void WorkerPool::beginProcessing(size_t image) { finished_tasks[image] = std::move(processing_tasks); }
-
-void WorkerPool::clearProcessed(size_t image) { deletion_tasks = std::move(finished_tasks[image]); }
+void WorkerPool::beginProcessing(size_t image)
+{
+    deletion_ring.beginFrame(image);
+    engine->renderer->beginTransientFrame();
+}
 
-void WorkerPool::deleteFinished() { deletion_tasks = {}; }
+void WorkerPool::clearProcessed(size_t image) { deletion_ring.flush(image); }
 
 void WorkerPool::Reset() {}
 } // namespace lotus
@@ -1,17 +1,34 @@
 module;
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <memory>
+#include <mutex>
+#include <stop_token>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 export module lotus:util.worker_pool;
 
+import :renderer.memory;
 import :util.async_queue;
-import :util.shared_linked_list;
+import :util.cancellation;
+import :util.coroutine_allocator;
+import :util.deletion_ring;
+import :util.locked_queue;
 import :util.task;
+import :util.timer_wheel;
+import :util.types;
+import :util.work_stealing_deque;
 import vulkan_hpp;
 
 namespace lotus
@@ -28,15 +45,35 @@ public:
     // temporary workaround for WorkerPromise's issues
     static inline WorkerPool* temp_pool;
 
+    // scheduling lanes, drained in order (with periodic starvation protection for the lower lanes)
+    enum class Priority
+    {
+        Critical,
+        Normal,
+        Background
+    };
+    static constexpr size_t priority_count{3};
+
+private:
+    // priority of the task currently running on this thread - newly scheduled tasks inherit it
+    static inline thread_local Priority current_priority{Priority::Normal};
+
+public:
     class ScheduledTask
     {
     public:
         // queue when suspended
-        ScheduledTask(WorkerPool* _pool) : pool(_pool) {}
+        ScheduledTask(WorkerPool* _pool) : pool(_pool), priority(current_priority) {}
+        ScheduledTask(WorkerPool* _pool, Priority _priority) : pool(_pool), priority(_priority) {}
         // queue an existing coroutine handle (must call queueTask after making sure the scheduledTask object is
         // constructed
         //  or else it might run before finishing construction/assignment)
-        ScheduledTask(WorkerPool* _pool, std::coroutine_handle<> _awaiting) : pool(_pool), awaiting(_awaiting) {}
+        ScheduledTask(WorkerPool* _pool, std::coroutine_handle<> _awaiting) : pool(_pool), priority(current_priority), awaiting(_awaiting) {}
+        // as above, for a coroutine that was suspended under a different cancellation token than this thread's
+        ScheduledTask(WorkerPool* _pool, std::coroutine_handle<> _awaiting, std::stop_token _stop_token)
+            : pool(_pool), priority(current_priority), stop_token(std::move(_stop_token)), awaiting(_awaiting)
+        {
+        }
         void queueTask() { pool->queueTask(this); }
 
         bool await_ready() noexcept { return false; }
@@ -45,21 +82,30 @@ public:
             awaiting = awaiter;
             pool->queueTask(this);
         }
-        void await_resume() noexcept {}
+        void await_resume() { CancellationScope::throwIfCancelled(); }
 
     private:
         friend class WorkerPool;
         WorkerPool* pool;
+        Priority priority;
+        std::stop_token stop_token{CancellationScope::token()};
         ScheduledTask* next{nullptr};
         std::coroutine_handle<> awaiting;
     };
 
+    // move the awaiting coroutine onto a worker thread in the given lane
+    [[nodiscard]]
+    ScheduledTask schedule(Priority priority)
+    {
+        return ScheduledTask{this, priority};
+    }
+
     struct CommandBuffers
     {
-        SharedLinkedList<vk::CommandBuffer> graphics_primary;
-        SharedLinkedList<vk::CommandBuffer> graphics_secondary;
-        SharedLinkedList<vk::CommandBuffer> shadowmap;
-        SharedLinkedList<vk::CommandBuffer> particle;
+        LockedQueue<vk::CommandBuffer> graphics_primary;
+        LockedQueue<vk::CommandBuffer> graphics_secondary;
+        LockedQueue<vk::CommandBuffer> shadowmap;
+        LockedQueue<vk::CommandBuffer> particle;
     } command_buffers;
 
     std::vector<vk::CommandBuffer> getPrimaryGraphicsBuffers(int);
@@ -84,16 +130,14 @@ public:
         void await_suspend(std::coroutine_handle<> awaiter) noexcept
         {
             awaiting = awaiter;
-            pool->main_task = this;
-            pool->worker_flag.clear();
-            pool->main_flag.test_and_set();
-            pool->main_flag.notify_one();
+            pool->queueMainTask(this);
         }
-        void await_resume() noexcept {}
+        void await_resume() { CancellationScope::throwIfCancelled(); }
 
     private:
         friend class WorkerPool;
         WorkerPool* pool;
+        std::stop_token stop_token{CancellationScope::token()};
         std::coroutine_handle<> awaiting;
     };
 
@@ -102,40 +146,124 @@ public:
     {
         return MainThreadTask{this};
     }
+
+    class SleepTask : public TimerWheel::Timer
+    {
+    public:
+        // resumed on a worker thread, in the lane of the task that started sleeping
+        SleepTask(WorkerPool* _pool, time_point _deadline) : TimerWheel::Timer{.deadline = _deadline}, pool(_pool), task(_pool) {}
+
+        bool await_ready() noexcept { return deadline <= sim_clock::now(); }
+        void await_suspend(std::coroutine_handle<> awaiter) noexcept { pool->queueTimer(this, awaiter); }
+        void await_resume() { CancellationScope::throwIfCancelled(); }
+
+    private:
+        friend class WorkerPool;
+        WorkerPool* pool;
+        ScheduledTask task;
+    };
+
+    // suspend the awaiting coroutine without holding a worker until the time is reached (with 1ms resolution)
+    [[nodiscard]]
+    SleepTask sleep_until(time_point time)
+    {
+        return SleepTask{this, time};
+    }
+    [[nodiscard]]
+    SleepTask sleep_for(duration delay)
+    {
+        return SleepTask{this, sim_clock::now() + delay};
+    }
+
     void queueTask(ScheduledTask*);
 
+    // scheduler counters, summed over every worker (for tuning the idle policy)
+    struct Metrics
+    {
+        uint64_t tasks_run{0};
+        uint64_t tasks_stolen{0};
+        // times an idle worker found new work while spinning, and times it gave up and slept
+        uint64_t spin_hits{0};
+        uint64_t parks{0};
+        std::chrono::nanoseconds spin_time{0};
+        std::chrono::nanoseconds park_time{0};
+    };
+    Metrics getMetrics() const;
+
 private:
     // friend class ScheduledTask;
     friend class MainThreadTask;
-    ScheduledTask* tryGetTask();
-    void runTasks(std::stop_token);
+
+    struct Worker
+    {
+        Worker(WorkerPool* _pool, uint32_t seed) : pool(_pool), rng_state(seed) {}
+        WorkerPool* pool;
+        std::array<WorkStealingDeque<ScheduledTask*>, priority_count> tasks;
+        uint32_t rng_state;
+        uint32_t pop_count{0};
+
+        // only written by the worker itself
+        std::atomic<uint64_t> tasks_run{0};
+        std::atomic<uint64_t> tasks_stolen{0};
+        std::atomic<uint64_t> spin_hits{0};
+        std::atomic<uint64_t> parks{0};
+        std::atomic<int64_t> spin_ns{0};
+        std::atomic<int64_t> park_ns{0};
+    };
+
+    // how often a worker checks the injection queue before its own deque, so that it can't be starved by local work
+    static constexpr uint32_t injection_interval{61};
+    // how often a worker checks the lanes in reverse order, so that background work keeps moving under load
+    static constexpr uint32_t starvation_interval{32};
+    // cap on the number of pause instructions between checks while an idle worker spins
+    static constexpr uint32_t max_spin_backoff{64};
+    std::chrono::nanoseconds spin_duration;
+
+    ScheduledTask* tryGetTask(Worker& worker);
+    ScheduledTask* tryGetTask(Worker& worker, Priority priority);
+    ScheduledTask* stealTask(Worker& worker, Priority priority);
+    void runTasks(std::stop_token, Worker& worker);
+    void waitForTask(Worker& worker);
+
+    void injectTask(ScheduledTask*);
+    ScheduledTask* tryGetInjectedTask(Priority priority);
 
     Engine* engine;
     std::vector<std::jthread> threads;
-    std::atomic<ScheduledTask*> task_head{nullptr};
+    std::vector<std::unique_ptr<Worker>> workers;
+    static inline thread_local Worker* current_worker{nullptr};
+
+    // tasks queued from outside of the worker threads (main thread, async compute, etc)
+    struct InjectionQueue
+    {
+        std::mutex mutex;
+        ScheduledTask* head{nullptr};
+        ScheduledTask* tail{nullptr};
+        // checked before taking the mutex, so idle workers polling empty lanes don't contend with producers
+        std::atomic<size_t> size{0};
+    };
+    std::array<InjectionQueue, priority_count> injection_queues;
+
+    // number of tasks queued but not yet picked up; idle workers sleep on this
+    alignas(64) std::atomic<int64_t> pending_tasks{0};
 
-    // main thread synchronization:
+    // main thread run queue: any number of tasks can be waiting for the main thread, and it resumes them in
+    //  batches (oldest first) without stopping the workers
+    void queueMainTask(MainThreadTask*);
     std::thread::id main_thread{std::this_thread::get_id()};
-    MainThreadTask* main_task{nullptr};
-    std::atomic_flag main_flag;
-    std::atomic_flag worker_flag;
+    LockedQueue<MainThreadTask*> main_tasks;
+    alignas(64) std::atomic<int64_t> pending_main_tasks{0};
 
-    SharedLinkedList<Task<>> processing_tasks;
-    std::vector<SharedLinkedList<Task<>>> finished_tasks;
-    SharedLinkedList<Task<>> deletion_tasks;
+    DeletionRing<vk::UniqueCommandBuffer, std::unique_ptr<Buffer>, std::unique_ptr<Image>> deletion_ring;
     std::exception_ptr exception;
 
-    template <typename... Args> Task<> gpuResourceTask(Args&&... args)
-    {
-        auto a = std::make_tuple<Args...>(std::forward<Args>(args)...);
-        co_await std::suspend_always{};
-    }
-
     struct BackgroundTask;
 
     struct BackgroundPromise
     {
         using coroutine_handle = std::coroutine_handle<BackgroundPromise>;
+        static void* operator new(std::size_t size) { return CoroutineAllocator::allocate(size); }
+        static void operator delete(void* ptr, std::size_t size) { CoroutineAllocator::deallocate(ptr, size); }
         auto initial_suspend() noexcept { return std::suspend_never{}; }
 
         struct final_awaitable
@@ -203,22 +331,43 @@ private:
 
     AsyncQueue<> frame_waiting_queue;
 
+    // sleeping tasks are handed to the timer thread through new_timers, and it owns the wheel.  it only needs waking
+    //  early if a new timer is due before its next wakeup
+    void queueTimer(SleepTask*, std::coroutine_handle<>);
+    void runTimers(std::stop_token);
+    LockedQueue<SleepTask*> new_timers;
+    std::atomic<bool> timers_queued{false};
+    std::atomic<time_point> next_timer_wakeup{time_point::max()};
+    std::mutex timer_mutex;
+    std::condition_variable_any timer_cv;
+    std::jthread timer_thread;
+
 public:
-    // move the arguments into a coroutine frame that will be deleted once the GPU is
-    //  guaranteed to have no need of it anymore (3 frames usually)
-    template <typename... Args> void gpuResource(Args&&... args)
+    // hold on to the arguments until the GPU is guaranteed to have no need of them anymore (the next time this
+    //  frame's slot comes around)
+    template <typename... Args> void gpuResource(Args&&... args) { (deletion_ring.retire(std::forward<Args>(args)), ...); }
+
+    // call func once the GPU has finished with the current frame
+    template <std::invocable F> void gpuCallback(F&& func) { deletion_ring.callback(std::forward<F>(func)); }
+
+    // run the task in the background (any worker tasks it schedules go into the background lane), cancelled through
+    //  stop_token (see CancellationScope)
+    template <Awaitable Task> void background(Task&& task, std::stop_token stop_token)
     {
-        auto task = gpuResourceTask(std::forward<Args>(args)...);
-        processing_tasks.queue(std::move(task));
+        CancellationScope scope{std::move(stop_token)};
+        background(std::move(task));
     }
 
-    // run the task in the background
+    // run the task in the background (any worker tasks it schedules go into the background lane)
     template <Awaitable Task> void background(Task&& task)
     {
+        CoroutineAllocator::ArenaScope no_arena{false};
         auto bg_task = make_background(std::move(task));
         const std::coroutine_handle<> handle = bg_task.handle;
         background_tasks.insert(std::make_pair(handle, std::move(bg_task)));
+        auto previous_priority = std::exchange(current_priority, Priority::Background);
         handle.resume();
+        current_priority = previous_priority;
     }
 
     // suspend the thread until the current frame is done on the CPU side
@@ -232,7 +381,6 @@ public:
 
     void beginProcessing(size_t image);
     void clearProcessed(size_t image);
-    void deleteFinished();
 };
 
 inline WorkerPool::BackgroundTask WorkerPool::BackgroundPromise::get_return_object() noexcept { return BackgroundTask{coroutine_handle::from_promise(*this)}; }
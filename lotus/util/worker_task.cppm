@@ -2,11 +2,14 @@ module;
 
 #include <atomic>
 #include <coroutine>
+#include <cstddef>
 #include <exception>
 #include <iostream>
 
 export module lotus:util.worker_task;
 
+import :util.cancellation;
+import :util.coroutine_allocator;
 import :util.worker_pool;
 
 namespace lotus
@@ -15,6 +18,9 @@ export template <typename Result = void> struct WorkerTask;
 
 struct WorkerPromise_base
 {
+    static void* operator new(std::size_t size) { return CoroutineAllocator::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) { CoroutineAllocator::deallocate(ptr, size); }
+
     auto initial_suspend() noexcept { return WorkerPool::ScheduledTask{WorkerPool::temp_pool}; }
 
     struct final_awaitable
@@ -32,6 +38,18 @@ struct WorkerPromise_base
     void unhandled_exception()
     {
         exception = std::current_exception();
+        try
+        {
+            throw;
+        }
+        catch (const TaskCancelled&)
+        {
+            // unwinding on purpose
+            return;
+        }
+        catch (...)
+        {
+        }
         std::cout << "Exception thrown in worker task" << std::endl;
     }
 
@@ -110,8 +128,13 @@ export template <typename Result> struct WorkerTask
             awaitable(std::coroutine_handle<promise_type> _handle) : handle(_handle) {}
             auto await_ready() const noexcept { return !handle || handle.done(); }
             auto await_suspend(std::coroutine_handle<> awaiting) noexcept { return handle.promise().next_handle.exchange(awaiting) != nullptr; }
-            auto await_resume() { return handle.promise().result(); }
+            auto await_resume()
+            {
+                cancellation.resume();
+                return handle.promise().result();
+            }
             std::coroutine_handle<promise_type> handle;
+            CancellationScope::Suspended cancellation;
         };
         return awaitable{handle};
     }
@@ -123,8 +146,13 @@ export template <typename Result> struct WorkerTask
             awaitable(std::coroutine_handle<promise_type> _handle) : handle(_handle) {}
             auto await_ready() const noexcept { return !handle || handle.done(); }
             auto await_suspend(std::coroutine_handle<> awaiting) noexcept { return handle.promise().next_handle.exchange(awaiting) != nullptr; }
-            auto await_resume() { return std::move(handle.promise()).result(); }
+            auto await_resume()
+            {
+                cancellation.resume();
+                return std::move(handle.promise()).result();
+            }
             std::coroutine_handle<promise_type> handle;
+            CancellationScope::Suspended cancellation;
         };
         return awaitable{handle};
     }